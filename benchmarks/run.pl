@@ -9,13 +9,17 @@ foreach $b (@bm) {
     if ($b =~ /([a-zA-Z0-9]+)\/([a-zA-Z0-9]+)\s+(.*)/) {
         #print "Running $1 $2\n";
         chdir $1;
-        $result = `/usr/bin/time ./$2 $3 2> .times`;
+        $dir = $1;
+        $main = $2;
+        $args = $3;
+        $opts = $args =~ /\+RTS (.*) -RTS/ ? " ($1)" : "";
+        $result = `/usr/bin/time ./$main $args 2> .times`;
         $time = `cat .times`; 
         chdir "..";
         #print $time;
         @timeflds = split(/\s+/, $time);
         $user = $timeflds[3];
-        print "$1 / $2 $user\n";
+        print "$dir / $main$opts $user\n";
         $total += $user;
     }
 }
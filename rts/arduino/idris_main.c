@@ -14,6 +14,10 @@ RTSOpts opts = {
 int main() {
     init(); // arduino init function
 
+    // Far too little memory for a nursery or a large object space
+    heap_opts.nursery_size = 0;
+    heap_opts.large_object_size = 0;
+
     VM* vm = init_vm(opts.max_stack_size, opts.init_heap_size, 1);
     _idris__123_runMain0_125_(vm, NULL);
 
@@ -2,8 +2,9 @@
 
 #include "idris_rts.h"
 
+#ifndef IMMEDIATE_BITS
 VAL idris_b8CopyForGC(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
+    uint8_t A = GETBITS8(a);
     VAL cl = allocate(sizeof(Closure), 1);
     SETTY(cl, CT_BITS8);
     cl->info.bits8 = A;
@@ -11,7 +12,7 @@ VAL idris_b8CopyForGC(VM *vm, VAL a) {
 }
 
 VAL idris_b16CopyForGC(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
+    uint16_t A = GETBITS16(a);
     VAL cl = allocate(sizeof(Closure), 1);
     SETTY(cl, CT_BITS16);
     cl->info.bits16 = A;
@@ -19,15 +20,16 @@ VAL idris_b16CopyForGC(VM *vm, VAL a) {
 }
 
 VAL idris_b32CopyForGC(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
+    uint32_t A = GETBITS32(a);
     VAL cl = allocate(sizeof(Closure), 1);
     SETTY(cl, CT_BITS32);
     cl->info.bits32 = A;
     return cl;
 }
+#endif
 
 VAL idris_b64CopyForGC(VM *vm, VAL a) {
-    uint64_t A = a->info.bits64;
+    uint64_t A = GETBITS64(a);
     VAL cl = allocate(sizeof(Closure), 1);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A;
@@ -36,26 +38,17 @@ VAL idris_b64CopyForGC(VM *vm, VAL a) {
 
 VAL idris_b8(VM *vm, VAL a) {
     uint8_t A = GETINT(a);
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) A;
-    return cl;
+    return MKB8(vm, (uint8_t) A);
 }
 
 VAL idris_b16(VM *vm, VAL a) {
     uint16_t A = GETINT(a);
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) A;
-    return cl;
+    return MKB16(vm, (uint16_t) A);
 }
 
 VAL idris_b32(VM *vm, VAL a) {
     uint32_t A = GETINT(a);
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) A;
-    return cl;
+    return MKB32(vm, (uint32_t) A);
 }
 
 VAL idris_b64(VM *vm, VAL a) {
@@ -67,28 +60,19 @@ VAL idris_b64(VM *vm, VAL a) {
 }
 
 VAL idris_castB32Int(VM *vm, VAL a) {
-    return MKINT((i_int)a->info.bits32);
+    return MKINT((i_int)GETBITS32(a));
 }
 
 VAL idris_b8const(VM *vm, uint8_t a) {
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = a;
-    return cl;
+    return MKB8(vm, a);
 }
 
 VAL idris_b16const(VM *vm, uint16_t a) {
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = a;
-    return cl;
+    return MKB16(vm, a);
 }
 
 VAL idris_b32const(VM *vm, uint32_t a) {
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = a;
-    return cl;
+    return MKB32(vm, a);
 }
 
 VAL idris_b64const(VM *vm, uint64_t a) {
@@ -99,443 +83,317 @@ VAL idris_b64const(VM *vm, uint64_t a) {
 }
 
 VAL idris_b8Plus(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A + B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A + B);
 }
 
 VAL idris_b8Minus(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A - B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A - B);
 }
 
 VAL idris_b8Times(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A * B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A * B);
 }
 
 VAL idris_b8UDiv(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A / B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A / B);
 }
 
 VAL idris_b8SDiv(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) (((int8_t) A) / ((int8_t) B));
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, (uint8_t) (((int8_t) A) / ((int8_t) B)));
 }
 
 VAL idris_b8URem(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A % B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A % B);
 }
 
 VAL idris_b8SRem(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) (((int8_t) A) % ((int8_t) B));
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, (uint8_t) (((int8_t) A) % ((int8_t) B)));
 }
 
 VAL idris_b8Lt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits8 < b->info.bits8));
+    return MKINT((i_int) (GETBITS8(a) < GETBITS8(b)));
 }
 
 VAL idris_b8Gt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits8 > b->info.bits8));
+    return MKINT((i_int) (GETBITS8(a) > GETBITS8(b)));
 }
 
 VAL idris_b8Eq(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits8 == b->info.bits8));
+    return MKINT((i_int) (GETBITS8(a) == GETBITS8(b)));
 }
 
 VAL idris_b8Lte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits8 <= b->info.bits8));
+    return MKINT((i_int) (GETBITS8(a) <= GETBITS8(b)));
 }
 
 VAL idris_b8Gte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits8 >= b->info.bits8));
+    return MKINT((i_int) (GETBITS8(a) >= GETBITS8(b)));
 }
 
 VAL idris_b8Compl(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = ~ A;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    return MKB8(vm, ~ A);
 }
 
 VAL idris_b8And(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A & B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A & B);
 }
 
 VAL idris_b8Or(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A | B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A | B);
 }
 
 VAL idris_b8Xor(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A ^ B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A ^ B);
 }
 
 VAL idris_b8Shl(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A << B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A << B);
 }
 
 VAL idris_b8LShr(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = A >> B;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, A >> B);
 }
 
 VAL idris_b8AShr(VM *vm, VAL a, VAL b) {
-    uint8_t A = a->info.bits8;
-    uint8_t B = b->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) (((int8_t) A) >> ((int8_t) B));
-    return cl;
+    uint8_t A = GETBITS8(a);
+    uint8_t B = GETBITS8(b);
+    return MKB8(vm, (uint8_t) (((int8_t) A) >> ((int8_t) B)));
 }
 
 VAL idris_b16Plus(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A + B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A + B);
 }
 
 VAL idris_b16Minus(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A - B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A - B);
 }
 
 VAL idris_b16Times(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A * B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A * B);
 }
 
 VAL idris_b16UDiv(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A / B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A / B);
 }
 
 VAL idris_b16SDiv(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) (((int16_t) A) / ((int16_t) B));
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, (uint16_t) (((int16_t) A) / ((int16_t) B)));
 }
 
 VAL idris_b16URem(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A % B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A % B);
 }
 
 VAL idris_b16SRem(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) (((int16_t) A) % ((int16_t) B));
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, (uint16_t) (((int16_t) A) % ((int16_t) B)));
 }
 
 VAL idris_b16Lt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits16 < b->info.bits16));
+    return MKINT((i_int) (GETBITS16(a) < GETBITS16(b)));
 }
 
 VAL idris_b16Gt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits16 > b->info.bits16));
+    return MKINT((i_int) (GETBITS16(a) > GETBITS16(b)));
 }
 
 VAL idris_b16Eq(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits16 == b->info.bits16));
+    return MKINT((i_int) (GETBITS16(a) == GETBITS16(b)));
 }
 
 VAL idris_b16Lte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits16 <= b->info.bits16));
+    return MKINT((i_int) (GETBITS16(a) <= GETBITS16(b)));
 }
 
 VAL idris_b16Gte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits16 >= b->info.bits16));
+    return MKINT((i_int) (GETBITS16(a) >= GETBITS16(b)));
 }
 
 VAL idris_b16Compl(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = ~ A;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    return MKB16(vm, ~ A);
 }
 
 VAL idris_b16And(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A & B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A & B);
 }
 
 VAL idris_b16Or(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A | B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A | B);
 }
 
 VAL idris_b16Xor(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A ^ B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A ^ B);
 }
 
 VAL idris_b16Shl(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A << B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A << B);
 }
 
 VAL idris_b16LShr(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = A >> B;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, A >> B);
 }
 
 VAL idris_b16AShr(VM *vm, VAL a, VAL b) {
-    uint16_t A = a->info.bits16;
-    uint16_t B = b->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) (((int16_t) A) >> ((int16_t) B));
-    return cl;
+    uint16_t A = GETBITS16(a);
+    uint16_t B = GETBITS16(b);
+    return MKB16(vm, (uint16_t) (((int16_t) A) >> ((int16_t) B)));
 }
 
 VAL idris_b32Plus(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A + B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A + B);
 }
 
 VAL idris_b32Minus(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A - B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A - B);
 }
 
 VAL idris_b32Times(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A * B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A * B);
 }
 
 VAL idris_b32UDiv(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A / B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A / B);
 }
 
 VAL idris_b32SDiv(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) (((int32_t) A) / ((int32_t) B));
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, (uint32_t) (((int32_t) A) / ((int32_t) B)));
 }
 
 VAL idris_b32URem(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A % B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A % B);
 }
 
 VAL idris_b32SRem(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) (((int32_t) A) % ((int32_t) B));
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, (uint32_t) (((int32_t) A) % ((int32_t) B)));
 }
 
 VAL idris_b32Lt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits32 < b->info.bits32));
+    return MKINT((i_int) (GETBITS32(a) < GETBITS32(b)));
 }
 
 VAL idris_b32Gt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits32 > b->info.bits32));
+    return MKINT((i_int) (GETBITS32(a) > GETBITS32(b)));
 }
 
 VAL idris_b32Eq(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits32 == b->info.bits32));
+    return MKINT((i_int) (GETBITS32(a) == GETBITS32(b)));
 }
 
 VAL idris_b32Lte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits32 <= b->info.bits32));
+    return MKINT((i_int) (GETBITS32(a) <= GETBITS32(b)));
 }
 
 VAL idris_b32Gte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits32 >= b->info.bits32));
+    return MKINT((i_int) (GETBITS32(a) >= GETBITS32(b)));
 }
 
 VAL idris_b32Compl(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = ~ A;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    return MKB32(vm, ~ A);
 }
 
 VAL idris_b32And(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A & B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A & B);
 }
 
 VAL idris_b32Or(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A | B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A | B);
 }
 
 VAL idris_b32Xor(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A ^ B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A ^ B);
 }
 
 VAL idris_b32Shl(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A << B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A << B);
 }
 
 VAL idris_b32LShr(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = A >> B;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, A >> B);
 }
 
 VAL idris_b32AShr(VM *vm, VAL a, VAL b) {
-    uint32_t A = a->info.bits32;
-    uint32_t B = b->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) (((int32_t)A) >> ((int32_t)B));
-    return cl;
+    uint32_t A = GETBITS32(a);
+    uint32_t B = GETBITS32(b);
+    return MKB32(vm, (uint32_t) (((int32_t)A) >> ((int32_t)B)));
 }
 
 VAL idris_b64Plus(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A + B;
@@ -543,8 +401,8 @@ VAL idris_b64Plus(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Minus(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A - B;
@@ -552,8 +410,8 @@ VAL idris_b64Minus(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Times(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A * B;
@@ -561,8 +419,8 @@ VAL idris_b64Times(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64UDiv(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A / B;
@@ -570,8 +428,8 @@ VAL idris_b64UDiv(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64SDiv(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (((int64_t) A) / ((int64_t) B));
@@ -579,8 +437,8 @@ VAL idris_b64SDiv(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64URem(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A % B;
@@ -588,8 +446,8 @@ VAL idris_b64URem(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64SRem(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (((int64_t) A) % ((int64_t) B));
@@ -597,27 +455,27 @@ VAL idris_b64SRem(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Lt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits64 < b->info.bits64));
+    return MKINT((i_int) (GETBITS64(a) < GETBITS64(b)));
 }
 
 VAL idris_b64Gt(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits64 > b->info.bits64));
+    return MKINT((i_int) (GETBITS64(a) > GETBITS64(b)));
 }
 
 VAL idris_b64Eq(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits64 == b->info.bits64));
+    return MKINT((i_int) (GETBITS64(a) == GETBITS64(b)));
 }
 
 VAL idris_b64Lte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits64 <= b->info.bits64));
+    return MKINT((i_int) (GETBITS64(a) <= GETBITS64(b)));
 }
 
 VAL idris_b64Gte(VM *vm, VAL a, VAL b) {
-    return MKINT((i_int) (a->info.bits64 >= b->info.bits64));
+    return MKINT((i_int) (GETBITS64(a) >= GETBITS64(b)));
 }
 
 VAL idris_b64Compl(VM *vm, VAL a) {
-    uint64_t A = a->info.bits64;
+    uint64_t A = GETBITS64(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = ~ A;
@@ -625,8 +483,8 @@ VAL idris_b64Compl(VM *vm, VAL a) {
 }
 
 VAL idris_b64And(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A & B;
@@ -634,8 +492,8 @@ VAL idris_b64And(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Or(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A | B;
@@ -643,8 +501,8 @@ VAL idris_b64Or(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Xor(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A ^ B;
@@ -652,8 +510,8 @@ VAL idris_b64Xor(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64Shl(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A << B;
@@ -661,8 +519,8 @@ VAL idris_b64Shl(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64LShr(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = A >> B;
@@ -670,8 +528,8 @@ VAL idris_b64LShr(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b64AShr(VM *vm, VAL a, VAL b) {
-    uint64_t A = a->info.bits64;
-    uint64_t B = b->info.bits64;
+    uint64_t A = GETBITS64(a);
+    uint64_t B = GETBITS64(b);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (((int64_t) A) >> ((int64_t) B));
@@ -679,23 +537,17 @@ VAL idris_b64AShr(VM *vm, VAL a, VAL b) {
 }
 
 VAL idris_b8Z16(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) A;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    return MKB16(vm, (uint16_t) A);
 }
 
 VAL idris_b8Z32(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) A;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    return MKB32(vm, (uint32_t) A);
 }
 
 VAL idris_b8Z64(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
+    uint8_t A = GETBITS8(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) A;
@@ -703,23 +555,17 @@ VAL idris_b8Z64(VM *vm, VAL a) {
 }
 
 VAL idris_b8S16(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) (int16_t) (int8_t) A;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    return MKB16(vm, (uint16_t) (int16_t) (int8_t) A);
 }
 
 VAL idris_b8S32(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) (int32_t) (int8_t) A;
-    return cl;
+    uint8_t A = GETBITS8(a);
+    return MKB32(vm, (uint32_t) (int32_t) (int8_t) A);
 }
 
 VAL idris_b8S64(VM *vm, VAL a) {
-    uint8_t A = a->info.bits8;
+    uint8_t A = GETBITS8(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (int64_t) (int8_t) A;
@@ -727,15 +573,12 @@ VAL idris_b8S64(VM *vm, VAL a) {
 }
 
 VAL idris_b16Z32(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) A;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    return MKB32(vm, (uint32_t) A);
 }
 
 VAL idris_b16Z64(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
+    uint16_t A = GETBITS16(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) A;
@@ -743,15 +586,12 @@ VAL idris_b16Z64(VM *vm, VAL a) {
 }
 
 VAL idris_b16S32(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) (int32_t) (int16_t) A;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    return MKB32(vm, (uint32_t) (int32_t) (int16_t) A);
 }
 
 VAL idris_b16S64(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
+    uint16_t A = GETBITS16(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (int64_t) (int16_t) A;
@@ -759,15 +599,12 @@ VAL idris_b16S64(VM *vm, VAL a) {
 }
 
 VAL idris_b16T8(VM *vm, VAL a) {
-    uint16_t A = a->info.bits16;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) A;
-    return cl;
+    uint16_t A = GETBITS16(a);
+    return MKB8(vm, (uint8_t) A);
 }
 
 VAL idris_b32Z64(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
+    uint32_t A = GETBITS32(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) A;
@@ -775,7 +612,7 @@ VAL idris_b32Z64(VM *vm, VAL a) {
 }
 
 VAL idris_b32S64(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
+    uint32_t A = GETBITS32(a);
     VAL cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_BITS64);
     cl->info.bits64 = (uint64_t) (int64_t) (int32_t) A;
@@ -783,43 +620,28 @@ VAL idris_b32S64(VM *vm, VAL a) {
 }
 
 VAL idris_b32T8(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) A;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    return MKB8(vm, (uint8_t) A);
 }
 
 VAL idris_b32T16(VM *vm, VAL a) {
-    uint32_t A = a->info.bits32;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) A;
-    return cl;
+    uint32_t A = GETBITS32(a);
+    return MKB16(vm, (uint16_t) A);
 }
 
 VAL idris_b64T8(VM *vm, VAL a) {
-    uint64_t A = a->info.bits64;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS8);
-    cl->info.bits8 = (uint8_t) A;
-    return cl;
+    uint64_t A = GETBITS64(a);
+    return MKB8(vm, (uint8_t) A);
 }
 
 VAL idris_b64T16(VM *vm, VAL a) {
-    uint64_t A = a->info.bits64;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS16);
-    cl->info.bits16 = (uint16_t) A;
-    return cl;
+    uint64_t A = GETBITS64(a);
+    return MKB16(vm, (uint16_t) A);
 }
 
 VAL idris_b64T32(VM *vm, VAL a) {
-    uint64_t A = a->info.bits64;
-    VAL cl = allocate(sizeof(Closure), 0);
-    SETTY(cl, CT_BITS32);
-    cl->info.bits32 = (uint32_t) A;
-    return cl;
+    uint64_t A = GETBITS64(a);
+    return MKB32(vm, (uint32_t) A);
 }
 
 VAL idris_peekB8(VM* vm, VAL ptr, VAL offset) {
@@ -1,9 +1,11 @@
 #ifndef _IDRISBITSTRING_H
 #define _IDRISBITSTRING_H
 
+#ifndef IMMEDIATE_BITS
 VAL idris_b8CopyForGC(VM *vm, VAL a);
 VAL idris_b16CopyForGC(VM *vm, VAL a);
 VAL idris_b32CopyForGC(VM *vm, VAL a);
+#endif
 VAL idris_b64CopyForGC(VM *vm, VAL a);
 
 VAL idris_b8(VM *vm, VAL a);
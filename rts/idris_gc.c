@@ -3,154 +3,1502 @@
 #include "idris_bitstring.h"
 #include <assert.h>
 
-VAL copy(VM* vm, VAL x) {
-    int ar;
-    Closure* cl = NULL;
-    if (x==NULL || ISINT(x)) {
-        return x;
+#define MAX_FROM_SPACES 3
+
+// A region being evacuated by the current collection
+typedef struct {
+    char* lo;
+    char* hi;
+} Space;
+
+typedef struct {
+    VM*    vm;
+    Space  from[MAX_FROM_SPACES];
+    int    nfrom;
+    Heap*  to;        // Where survivors are promoted to
+    Heap*  survivor;  // Where young survivors wait, NULL in a major collection
+    int    minor;
+    size_t copied;
+} GC;
+
+static void add_from_space(GC* gc, Heap* h) {
+    assert(gc->nfrom < MAX_FROM_SPACES);
+    gc->from[gc->nfrom].lo = h->heap;
+    gc->from[gc->nfrom].hi = h->next;
+    gc->nfrom++;
+}
+
+static int in_from_space(GC* gc, VAL x) {
+    int i;
+    for (i = 0; i < gc->nfrom; ++i) {
+        if ((char*)x >= gc->from[i].lo && (char*)x < gc->from[i].hi) {
+            return 1;
+        }
     }
-    switch(GETTY(x)) {
-    case CT_CON:
-        ar = CARITY(x);
-        if (ar == 0 && CTAG(x) < 256) {
-            return x;
-        } else {
-            allocCon(cl, vm, CTAG(x), ar, 1);
-            memcpy(&(cl->info.c.args), &(x->info.c.args), sizeof(VAL)*ar);
+    return 0;
+}
+
+static int fits(Heap* h, size_t size) {
+    return h->next + size <= h->end;
+}
+
+static VAL move(GC* gc, Heap* to, VAL x) {
+    size_t size = CLOSURE_SIZE(x);
+    VAL cl = (VAL)to->next;
+
+    assert(fits(to, size));
+    memcpy(cl, x, size);
+    to->next += size;
+    gc->copied += size;
+
+    return cl;
+}
+
+// Some closures point into themselves; fix those pointers after a move.
+static void relocate(VAL cl) {
+    char* payload = (char*)cl + sizeof(Closure);
+
+    switch(GETTY(cl)) {
+    case CT_STRING:
+        if (cl->info.str != NULL) {
+            cl->info.str = payload + sizeof(StrInfo);
         }
         break;
-    case CT_FLOAT:
-        cl = MKFLOATc(vm, x->info.f);
+    case CT_STROFFSET:
+        cl->info.str_offset = (StrOffset*)payload;
         break;
-    case CT_STRING:
-        cl = MKSTRc(vm, x->info.str);
+    case CT_STRCONCAT:
+        cl->info.str_concat = (StrConcat*)payload;
         break;
-    case CT_STROFFSET:
-        cl = MKSTROFFc(vm, x->info.str_offset);
+    case CT_MANAGEDPTR:
+        cl->info.mptr = (ManagedPtr*)payload;
+        cl->info.mptr->data = payload + sizeof(ManagedPtr);
         break;
     case CT_BIGINT:
-        cl = MKBIGMc(vm, x->info.ptr);
+        cl->info.ptr = payload;
         break;
-    case CT_PTR:
-        cl = MKPTRc(vm, x->info.ptr);
+    default:
         break;
-    case CT_MANAGEDPTR:
-        cl = MKMPTRc(vm, x->info.mptr->data, x->info.mptr->size);
+    }
+}
+
+// A string's index of character positions (see str_char) is a large
+// object, which lives as long as the string.
+static void mark_str_index(GC* gc, VAL x) {
+    if (!gc->minor && GETTY(x) == CT_STRING && STRINFO(x)->index != NULL) {
+        large_heap_mark(STRINFO(x)->index);
+    }
+}
+
+// Large objects are never moved, only marked. They hold no references
+// but the index of a large string, so there is nothing to do for them in
+// a minor collection.
+static void mark_large(GC* gc, VAL x) {
+    if (!gc->minor && (x->hdr & LARGE)) {
+        large_heap_mark(x);
+        mark_str_index(gc, x);
+    }
+}
+
+static VAL evacuate(GC* gc, VAL x) {
+    if (x == NULL || ISIMM(x)) {
+        return x;
+    }
+    if (!in_from_space(gc, x)) {
+        mark_large(gc, x);
+        return x;
+    }
+    if (GETTY(x) == CT_FWD) {
+        return x->info.ptr;
+    }
+
+    // Young objects wait in the survivor space until they are old enough,
+    // unless they don't fit there. Big integers are always promoted, so
+    // that their limbs are never younger than they are.
+    Heap* dest = gc->to;
+    int age = GETAGE(x) + 1;
+    if (gc->survivor != NULL && age < heap_opts.tenure_age &&
+        GETTY(x) != CT_BIGINT && fits(gc->survivor, CLOSURE_SIZE(x))) {
+        dest = gc->survivor;
+    } else {
+        age = 0;
+    }
+
+    VAL cl = move(gc, dest, x);
+    cl->hdr &= ~HDR_GC_MASK;
+    SETAGE(cl, age);
+    relocate(cl);
+
+    switch(GETTY(cl)) {
+    case CT_BIGINT:
+        {
+            // The limbs live in their own CT_RAWDATA closure (see idris_alloc)
+            mpz_t* big = (mpz_t*)cl->info.ptr;
+            VAL limbs = (VAL)((char*)((*big)->_mp_d) - sizeof(Closure));
+            if ((*big)->_mp_alloc == 0) {
+                // No limbs
+            } else if (in_from_space(gc, limbs)) {
+                if (GETTY(limbs) != CT_FWD) {
+                    VAL moved = move(gc, dest, limbs);
+                    SETTY(limbs, CT_FWD);
+                    limbs->info.ptr = moved;
+                }
+                (*big)->_mp_d = (void*)((char*)(limbs->info.ptr) + sizeof(Closure));
+            } else {
+                mark_large(gc, limbs);
+            }
+        }
         break;
-    case CT_BITS8:
-        cl = idris_b8CopyForGC(vm, x);
+    case CT_CDATA:
+        if (!gc->minor) {
+            c_heap_mark_item(cl->info.c_heap_item);
+        }
         break;
-    case CT_BITS16:
-        cl = idris_b16CopyForGC(vm, x);
+    case CT_STRING:
+        mark_str_index(gc, cl);
         break;
-    case CT_BITS32:
-        cl = idris_b32CopyForGC(vm, x);
+    default:
         break;
-    case CT_BITS64:
-        cl = idris_b64CopyForGC(vm, x);
+    }
+
+    SETTY(x, CT_FWD);
+    x->info.ptr = cl;
+    return cl;
+}
+
+static int is_young(GC* gc, VAL x) {
+    return gc->survivor != NULL && !ISIMM(x) &&
+        (char*)x >= gc->survivor->heap && (char*)x < gc->survivor->next;
+}
+
+// Evacuate the children of a closure, returning whether any of them
+// are still young.
+static int scavenge(GC* gc, VAL heap_item) {
+    int i;
+    int ar;
+    int young = 0;
+    VAL child;
+
+    // If it's a CT_CON or a CT_STROFFSET or CT_STRCONCAT, copy its arguments
+    switch(GETTY(heap_item)) {
+    case CT_CON:
+        ar = ARITY(heap_item);
+        for(i = 0; i < ar; ++i) {
+            child = evacuate(gc, CARGS(heap_item)[i]);
+            SETARG(heap_item, i, child);
+            young |= is_young(gc, child);
+        }
         break;
-    case CT_FWD:
-        return x->info.ptr;
-    case CT_RAWDATA:
+    case CT_STROFFSET:
+        child = evacuate(gc, heap_item->info.str_offset->str);
+        heap_item->info.str_offset->str = child;
+        young |= is_young(gc, child);
+        break;
+    case CT_STRCONCAT:
+        child = evacuate(gc, heap_item->info.str_concat->left);
+        heap_item->info.str_concat->left = child;
+        young |= is_young(gc, child);
+        child = evacuate(gc, heap_item->info.str_concat->right);
+        heap_item->info.str_concat->right = child;
+        young |= is_young(gc, child);
+        break;
+    default: // Nothing to copy
+        break;
+    }
+    return young;
+}
+
+// Scan the objects in 'h' from 'scan' up to the end of what has been
+// copied. Objects in the old generation which still refer to young
+// objects are remembered.
+static char* cheney(GC* gc, Heap* h, char* scan) {
+    int remember = gc->minor && h == gc->to;
+
+    while(scan < h->next) {
+       VAL heap_item = (VAL)scan;
+
+       if (scavenge(gc, heap_item) && remember) {
+           remset_add(&gc->vm->gen.remembered, heap_item);
+       }
+       scan += CLOSURE_SIZE(heap_item);
+    }
+    assert(scan == h->next);
+    return scan;
+}
+
+static void evacuate_roots(GC* gc) {
+    VM* vm = gc->vm;
+    VAL* root;
+
+    for(root = vm->valstack; root < vm->valstack_top; ++root) {
+        *root = evacuate(gc, *root);
+    }
+
+#ifdef HAS_PTHREAD
+    Msg* msg;
+
+    for(msg = vm->inbox; msg < vm->inbox_write; ++msg) {
+        msg->msg = evacuate(gc, msg->msg);
+    }
+#endif
+
+    vm->ret = evacuate(gc, vm->ret);
+    vm->reg1 = evacuate(gc, vm->reg1);
+}
+
+// Scan the remembered set, keeping only the objects which still point
+// into the young generation afterwards.
+static void scan_remembered(GC* gc) {
+    RemSet* rs = &gc->vm->gen.remembered;
+    size_t i;
+    size_t kept = 0;
+
+    for(i = 0; i < rs->count; ++i) {
+        VAL item = rs->items[i];
+        if (scavenge(gc, item)) {
+            rs->items[kept++] = item;
+        } else {
+            item->hdr &= ~REMEMBERED;
+        }
+    }
+    rs->count = kept;
+}
+
+static size_t used(Heap* h) {
+    return h->next - h->heap;
+}
+
+static size_t minor_gc(VM* vm) {
+    Generations* gen = &vm->gen;
+    GC gc = { vm, {{0}}, 0, &gen->old, &gen->survivor, 1, 0 };
+
+    add_from_space(&gc, &vm->heap);
+    add_from_space(&gc, &gen->survivor);
+    flip_heap(&vm->heap);
+    flip_heap(&gen->survivor);
+
+    char* scan_old = gen->old.next;
+    char* scan_survivor = gen->survivor.heap;
+
+    evacuate_roots(&gc);
+    scan_remembered(&gc);
+
+    while (scan_old < gen->old.next || scan_survivor < gen->survivor.next) {
+        scan_old = cheney(&gc, &gen->old, scan_old);
+        scan_survivor = cheney(&gc, &gen->survivor, scan_survivor);
+    }
+
+    return gc.copied;
+}
+
+#ifdef HAS_PTHREAD
+/* *** Parallel copying ***
+ * With several GC threads (+RTS -gN), a copying major collection shares
+ * out the scanning of to-space. Each thread copies into a block of
+ * to-space of its own and scans it as Cheney's algorithm would. When the
+ * block fills up, whatever of it is not yet scanned goes on the thread's
+ * queue, from which idle threads steal.
+ *
+ * Several threads may reach the same closure at once, so a closure is
+ * claimed by atomically setting COPYING in its header, and becomes a
+ * CT_FWD once its copy is complete. Anyone else finding it COPYING waits.
+ */
+
+#define PAR_BLOCK_SIZE 32768
+
+typedef struct {
+    char* lo;
+    char* hi;
+} ScanRange;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ScanRange* items;
+    size_t     count;
+    size_t     capacity;
+} WorkQueue;
+
+struct ParGC;
+
+typedef struct {
+    struct ParGC* par;
+    char*  next; // Free part of this thread's block of to-space
+    char*  end;
+    char*  scan; // Next closure in the block to scan
+    size_t copied;
+    WorkQueue queue;
+    pthread_t thread;
+} GCWorker;
+
+typedef struct ParGC {
+    GC*       gc;
+    GCWorker* workers;
+    int       nworkers;
+    int       active; // Threads which may still find more work
+} ParGC;
+
+static void queue_push(WorkQueue* q, char* lo, char* hi) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) {
+        q->capacity = q->capacity == 0 ? 64 : q->capacity * 2;
+        q->items = realloc(q->items, q->capacity * sizeof(ScanRange));
+        if (q->items == NULL) {
+            fprintf(stderr, "RTS ERROR: Unable to grow the GC work queue.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    q->items[q->count].lo = lo;
+    q->items[q->count].hi = hi;
+    __atomic_store_n(&q->count, q->count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// The owner takes the newest range, thieves the oldest.
+static int queue_take(WorkQueue* q, ScanRange* r, int steal) {
+    int found = 0;
+
+    if (__atomic_load_n(&q->count, __ATOMIC_ACQUIRE) == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        if (steal) {
+            *r = q->items[0];
+            memmove(q->items, q->items + 1, (q->count - 1) * sizeof(ScanRange));
+        } else {
+            *r = q->items[q->count - 1];
+        }
+        __atomic_store_n(&q->count, q->count - 1, __ATOMIC_RELEASE);
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static char* claim(GCWorker* w, size_t size) {
+    Heap* to = w->par->gc->to;
+    char* mem = __atomic_fetch_add(&to->next, size, __ATOMIC_RELAXED);
+
+    if (mem + size > to->end) {
+        fprintf(stderr, "RTS ERROR: Parallel GC ran out of to-space.\n");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+// Give up the rest of the current block, leaving it walkable.
+static void retire_block(GCWorker* w) {
+    if (w->scan < w->next) {
+        queue_push(&w->queue, w->scan, w->next);
+    }
+    if (w->next < w->end) {
+        VAL filler = (VAL)w->next;
+        filler->hdr = PAYLOAD_HDR(w->end - w->next - sizeof(Closure)) | CT_RAWDATA;
+    }
+    w->next = w->end = w->scan = NULL;
+}
+
+static VAL par_alloc(GCWorker* w, size_t size) {
+    size_t left = w->end - w->next;
+    char* mem;
+
+    // Big closures get room of their own, and are scanned from the queue.
+    if (size >= PAR_BLOCK_SIZE / 8) {
+        return (VAL)claim(w, size);
+    }
+    // Never leave a gap too small to be filled with a closure.
+    if (size > left || (size < left && left - size < sizeof(Closure))) {
+        retire_block(w);
+        w->next = w->scan = claim(w, PAR_BLOCK_SIZE);
+        w->end = w->next + PAR_BLOCK_SIZE;
+    }
+    mem = w->next;
+    w->next += size;
+    return (VAL)mem;
+}
+
+static VAL par_evacuate(GCWorker* w, VAL x);
+
+static VAL par_forward(GCWorker* w, VAL x) {
+    uint64_t hdr = __atomic_load_n(&x->hdr, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        if ((hdr & 0xff) == CT_FWD) {
+            if (!(hdr & COPYING)) {
+                return x->info.ptr;
+            }
+            sched_yield();
+            hdr = __atomic_load_n(&x->hdr, __ATOMIC_ACQUIRE);
+        } else if (__atomic_compare_exchange_n(&x->hdr, &hdr,
+                                               (uint64_t)(COPYING | CT_FWD), 0,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+
+    Closure orig;
+    orig.hdr = hdr;
+    size_t size = CLOSURE_SIZE(&orig);
+    VAL cl = par_alloc(w, size);
+
+    memcpy(cl, x, size);
+    cl->hdr = hdr & ~HDR_GC_MASK;
+    relocate(cl);
+    w->copied += size;
+    if (size >= PAR_BLOCK_SIZE / 8 && GETTY(cl) == CT_CON) {
+        queue_push(&w->queue, (char*)cl, (char*)cl + size);
+    }
+
+    switch(GETTY(cl)) {
+    case CT_BIGINT:
         {
-            size_t size = x->info.size + sizeof(Closure);
-            cl = allocate(size, 0);
-            memcpy(cl, x, size);
+            // The limbs live in their own CT_RAWDATA closure (see idris_alloc)
+            mpz_t* big = (mpz_t*)cl->info.ptr;
+            if ((*big)->_mp_alloc != 0) {
+                VAL limbs = (VAL)((char*)((*big)->_mp_d) - sizeof(Closure));
+                limbs = par_evacuate(w, limbs);
+                (*big)->_mp_d = (void*)((char*)limbs + sizeof(Closure));
+            }
         }
         break;
     case CT_CDATA:
-        cl = MKCDATAc(vm, x->info.c_heap_item);
-        c_heap_mark_item(x->info.c_heap_item);
+        c_heap_mark_item(cl->info.c_heap_item);
+        break;
+    case CT_STRING:
+        mark_str_index(w->par->gc, cl);
         break;
     default:
         break;
     }
-    SETTY(x, CT_FWD);
+
     x->info.ptr = cl;
+    __atomic_store_n(&x->hdr, (uint64_t)CT_FWD, __ATOMIC_RELEASE);
     return cl;
 }
 
-void cheney(VM *vm) {
+static VAL par_evacuate(GCWorker* w, VAL x) {
+    if (x == NULL || ISIMM(x)) {
+        return x;
+    }
+    if (!in_from_space(w->par->gc, x)) {
+        mark_large(w->par->gc, x);
+        return x;
+    }
+    return par_forward(w, x);
+}
+
+static void par_scavenge(GCWorker* w, VAL heap_item) {
     int i;
     int ar;
-    char* scan = vm->heap.heap;
-
-    while(scan < vm->heap.next) {
-       size_t inc = *((size_t*)scan);
-       VAL heap_item = (VAL)(scan+sizeof(size_t));
-       // If it's a CT_CON or CT_STROFFSET, copy its arguments
-       switch(GETTY(heap_item)) {
-       case CT_CON:
-           ar = ARITY(heap_item);
-           for(i = 0; i < ar; ++i) {
-               VAL newptr = copy(vm, heap_item->info.c.args[i]);
-               heap_item->info.c.args[i] = newptr;
-           }
-           break;
-       case CT_STROFFSET:
-           heap_item->info.str_offset->str
-               = copy(vm, heap_item->info.str_offset->str);
-           break;
-       default: // Nothing to copy
-           break;
-       }
-       scan += inc;
+
+    switch(GETTY(heap_item)) {
+    case CT_CON:
+        ar = CARITY(heap_item);
+        for(i = 0; i < ar; ++i) {
+            SETARG(heap_item, i, par_evacuate(w, CARGS(heap_item)[i]));
+        }
+        break;
+    case CT_STROFFSET:
+        heap_item->info.str_offset->str =
+            par_evacuate(w, heap_item->info.str_offset->str);
+        break;
+    case CT_STRCONCAT:
+        heap_item->info.str_concat->left =
+            par_evacuate(w, heap_item->info.str_concat->left);
+        heap_item->info.str_concat->right =
+            par_evacuate(w, heap_item->info.str_concat->right);
+        break;
+    default:
+        break;
     }
-    assert(scan == vm->heap.next);
 }
 
-void idris_gc(VM* vm) {
-    HEAP_CHECK(vm)
-    STATS_ENTER_GC(vm->stats, vm->heap.size)
+static void scan_range(GCWorker* w, char* scan, char* end) {
+    while (scan < end) {
+        VAL heap_item = (VAL)scan;
+        scan += CLOSURE_SIZE(heap_item);
+        par_scavenge(w, heap_item);
+    }
+}
+
+static int find_work(GCWorker* w, ScanRange* r) {
+    ParGC* par = w->par;
+    int i;
 
-    if (vm->heap.old != NULL)
-        free(vm->heap.old);
+    if (queue_take(&w->queue, r, 0)) {
+        return 1;
+    }
+    for (i = 0; i < par->nworkers; ++i) {
+        if (&par->workers[i] != w && queue_take(&par->workers[i].queue, r, 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int any_work(ParGC* par) {
+    int i;
+    for (i = 0; i < par->nworkers; ++i) {
+        if (__atomic_load_n(&par->workers[i].queue.count, __ATOMIC_ACQUIRE) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Work is only ever queued by active threads, so once none are active
+// and all queues are empty, the collection is over.
+static void* par_work(void* arg) {
+    GCWorker* w = (GCWorker*)arg;
+    ParGC* par = w->par;
+    ScanRange r;
+
+    for (;;) {
+        if (w->scan < w->next) {
+            VAL heap_item = (VAL)w->scan;
+            w->scan += CLOSURE_SIZE(heap_item);
+            par_scavenge(w, heap_item);
+        } else if (find_work(w, &r)) {
+            scan_range(w, r.lo, r.hi);
+        } else {
+            __atomic_sub_fetch(&par->active, 1, __ATOMIC_ACQ_REL);
+            while (!any_work(par)) {
+                if (__atomic_load_n(&par->active, __ATOMIC_ACQUIRE) == 0) {
+                    retire_block(w);
+                    return NULL;
+                }
+                sched_yield();
+            }
+            __atomic_add_fetch(&par->active, 1, __ATOMIC_ACQ_REL);
+        }
+    }
+}
+
+// Scan everything copied to 'gc->to' from 'scan' onwards, and whatever
+// that leads to, with 'nworkers' threads.
+static void par_cheney(GC* gc, char* scan, int nworkers) {
+    ParGC par;
+    GCWorker* workers = calloc(nworkers, sizeof(GCWorker));
+    int i;
+
+    if (workers == NULL) {
+        fprintf(stderr, "RTS ERROR: Unable to allocate GC threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    par.gc = gc;
+    par.workers = workers;
+    par.nworkers = nworkers;
+    par.active = nworkers;
+
+    for (i = 0; i < nworkers; ++i) {
+        workers[i].par = &par;
+        pthread_mutex_init(&workers[i].queue.lock, NULL);
+    }
+
+    // Share out what has been copied so far.
+    i = 0;
+    while (scan < gc->to->next) {
+        char* lo = scan;
+        while (scan < gc->to->next && scan - lo < PAR_BLOCK_SIZE) {
+            scan += CLOSURE_SIZE((VAL)scan);
+        }
+        queue_push(&workers[i].queue, lo, scan);
+        i = (i + 1) % nworkers;
+    }
+
+    for (i = 1; i < nworkers; ++i) {
+        if (pthread_create(&workers[i].thread, NULL, par_work, &workers[i]) != 0) {
+            fprintf(stderr, "RTS ERROR: Unable to start GC thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    par_work(&workers[0]);
+
+    for (i = 0; i < nworkers; ++i) {
+        if (i > 0) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        gc->copied += workers[i].copied;
+        pthread_mutex_destroy(&workers[i].queue.lock);
+        free(workers[i].queue.items);
+    }
+    free(workers);
+}
+#endif
+
+static size_t major_gc(VM* vm) {
+    Generations* gen = &vm->gen;
+    GC gc = { vm, {{0}}, 0, NULL, NULL, 0, 0 };
+    Heap* to = gen->enabled ? &gen->old : &vm->heap;
+
+    add_from_space(&gc, &vm->heap);
+    if (gen->enabled) {
+        size_t live = used(&vm->heap) + used(&gen->survivor) + used(&gen->old);
+
+        add_from_space(&gc, &gen->survivor);
+        add_from_space(&gc, &gen->old);
+        flip_heap(&vm->heap);
+        flip_heap(&gen->survivor);
+
+        // Everything might survive, so make sure it fits.
+        if (gen->old.size < live) {
+            gen->old.size = live;
+        }
+        gen->remembered.count = 0;
+        gen->remembered.untyped = false;
+    } else if (to->size < used(to)) {
+        // Everything might survive, so make sure it fits.
+        to->size = used(to);
+    }
+
+#ifdef HAS_PTHREAD
+    // Parallel copying leaves some of each thread's last blocks unused.
+    size_t size = to->size;
+    if (heap_opts.gc_threads > 1) {
+        to->size += to->size / 4 + heap_opts.gc_threads * 2 * PAR_BLOCK_SIZE;
+    }
+#endif
+
+    /* Swap to the other region, as big as the heap needs to be now. */
+    flip_heap(to);
+    gc.to = to;
+
+    evacuate_roots(&gc);
+#ifdef HAS_PTHREAD
+    to->size = size;
+    if (heap_opts.gc_threads > 1) {
+        par_cheney(&gc, to->heap, heap_opts.gc_threads);
+    } else
+#endif
+    {
+        cheney(&gc, to, to->heap);
+    }
+
+    // finally, sweep the C heap and the large objects
+    c_heap_sweep(&vm->c_heap);
+    large_heap_sweep(&vm->large_heap);
+    vm->live = used(to);
+    return gc.copied;
+}
+
+/* *** Mark-compact ***
+ * A major collection which needs no to-space: live closures are marked,
+ * then slid down to the bottom of the heap (the old generation, when
+ * collecting generationally) in address order. Afterwards, anything
+ * still young is promoted into the room left above them.
+ *
+ * New addresses are never stored in the closures. They are computed
+ * from a side table with one bit per word of live data, and the new
+ * address of the first live word of each block of 64 words:
+ *
+ *   new(x) = dest[block(x)] + live words before x in its block
+ *
+ * Sliding overwrites closures in place, so C code must not be holding
+ * pointers into the heap. Only collections from a safe point (see
+ * idris_safeGC) compact; any others copy.
+ */
+
+#define WORD_BITS 64
+#define WORD_BYTES sizeof(uint64_t)
+#define BLOCK_BYTES (WORD_BITS * WORD_BYTES)
+
+typedef struct {
+    char*     lo;
+    char*     hi;
+    uint64_t* live; // One bit per word of live closures
+} MarkSpace;
 
-    /* Allocate swap heap. */
-    alloc_heap(&vm->heap, vm->heap.size, vm->heap.growth, vm->heap.heap);
+typedef struct {
+    VM*        vm;
+    MarkSpace  spaces[MAX_FROM_SPACES]; // spaces[0] is compacted
+    int        nspaces;
+    char**     dest;  // New address of the first live word of each block
+    VAL*       stack; // Closures marked, but whose children aren't yet
+    size_t     stack_size;
+    size_t     stack_capacity;
+} Compactor;
 
+static void add_mark_space(Compactor* c, Heap* h) {
+    MarkSpace* ms = &c->spaces[c->nspaces++];
+    size_t blocks = (h->next - h->heap + BLOCK_BYTES - 1) / BLOCK_BYTES;
+
+    ms->lo = h->heap;
+    ms->hi = h->next;
+    ms->live = calloc(blocks + 1, sizeof(uint64_t));
+    if (ms->live == NULL) {
+        fprintf(stderr, "RTS ERROR: Unable to allocate mark bitmap.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static MarkSpace* find_space(Compactor* c, VAL x) {
+    int i;
+    for (i = 0; i < c->nspaces; ++i) {
+        if ((char*)x >= c->spaces[i].lo && (char*)x < c->spaces[i].hi) {
+            return &c->spaces[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t word_index(MarkSpace* ms, VAL x) {
+    return ((char*)x - ms->lo) / WORD_BYTES;
+}
+
+static int is_marked(MarkSpace* ms, size_t w) {
+    return (ms->live[w / WORD_BITS] >> (w % WORD_BITS)) & 1;
+}
+
+static void set_live(MarkSpace* ms, size_t w, size_t words) {
+    for (; words > 0; ++w, --words) {
+        ms->live[w / WORD_BITS] |= (uint64_t)1 << (w % WORD_BITS);
+    }
+}
+
+static void mark(Compactor* c, VAL x) {
+    if (x == NULL || ISIMM(x)) {
+        return;
+    }
+
+    MarkSpace* ms = find_space(c, x);
+    if (ms == NULL) {
+        // Static, or in the large object space
+        if (x->hdr & LARGE) {
+            large_heap_mark(x);
+            if (GETTY(x) == CT_STRING) {
+                mark(c, STRINFO(x)->index);
+            }
+        }
+        return;
+    }
+
+    size_t w = word_index(ms, x);
+    if (is_marked(ms, w)) {
+        return;
+    }
+    set_live(ms, w, CLOSURE_SIZE(x) / WORD_BYTES);
+
+    if (c->stack_size == c->stack_capacity) {
+        c->stack_capacity = c->stack_capacity == 0 ? 1024 : c->stack_capacity * 2;
+        c->stack = realloc(c->stack, c->stack_capacity * sizeof(VAL));
+        if (c->stack == NULL) {
+            fprintf(stderr, "RTS ERROR: Unable to grow the mark stack.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    c->stack[c->stack_size++] = x;
+}
+
+// The limbs of a big integer live in their own CT_RAWDATA closure
+// (see idris_alloc), or nowhere if it has none yet.
+static VAL bigint_limbs(VAL x) {
+    mpz_t* big = (mpz_t*)x->info.ptr;
+    if ((*big)->_mp_alloc == 0) {
+        return NULL;
+    }
+    return (VAL)((char*)((*big)->_mp_d) - sizeof(Closure));
+}
+
+static void mark_children(Compactor* c, VAL x) {
+    int i;
+
+    switch(GETTY(x)) {
+    case CT_CON:
+        for(i = 0; i < CARITY(x); ++i) {
+            mark(c, CARGS(x)[i]);
+        }
+        break;
+    case CT_STROFFSET:
+        mark(c, x->info.str_offset->str);
+        break;
+    case CT_STRCONCAT:
+        mark(c, x->info.str_concat->left);
+        mark(c, x->info.str_concat->right);
+        break;
+    case CT_BIGINT:
+        mark(c, bigint_limbs(x));
+        break;
+    case CT_STRING:
+        mark(c, STRINFO(x)->index);
+        break;
+    case CT_CDATA:
+        c_heap_mark_item(x->info.c_heap_item);
+        break;
+    default:
+        break;
+    }
+}
+
+static void mark_roots(Compactor* c) {
+    VM* vm = c->vm;
     VAL* root;
 
     for(root = vm->valstack; root < vm->valstack_top; ++root) {
-        *root = copy(vm, *root);
+        mark(c, *root);
+    }
+#ifdef HAS_PTHREAD
+    Msg* msg;
+
+    for(msg = vm->inbox; msg < vm->inbox_write; ++msg) {
+        mark(c, msg->msg);
+    }
+#endif
+    mark(c, vm->ret);
+    mark(c, vm->reg1);
+
+    while (c->stack_size > 0) {
+        mark_children(c, c->stack[--c->stack_size]);
+    }
+}
+
+static size_t live_bytes(MarkSpace* ms) {
+    size_t blocks = (ms->hi - ms->lo + BLOCK_BYTES - 1) / BLOCK_BYTES;
+    size_t b;
+    size_t words = 0;
+
+    for (b = 0; b < blocks; ++b) {
+        words += __builtin_popcountll(ms->live[b]);
+    }
+    return words * WORD_BYTES;
+}
+
+static void compute_destinations(Compactor* c, char* base) {
+    MarkSpace* ms = &c->spaces[0];
+    size_t blocks = (ms->hi - ms->lo + BLOCK_BYTES - 1) / BLOCK_BYTES;
+    size_t b;
+
+    c->dest = malloc((blocks + 1) * sizeof(char*));
+    if (c->dest == NULL) {
+        fprintf(stderr, "RTS ERROR: Unable to allocate compaction table.\n");
+        exit(EXIT_FAILURE);
     }
+    for (b = 0; b < blocks; ++b) {
+        c->dest[b] = base;
+        base += __builtin_popcountll(ms->live[b]) * WORD_BYTES;
+    }
+}
+
+// Where a closure will be once the heap is compacted
+static VAL forward(Compactor* c, VAL x) {
+    MarkSpace* ms = &c->spaces[0];
+
+    if (x == NULL || ISIMM(x) || (char*)x < ms->lo || (char*)x >= ms->hi) {
+        return x;
+    }
+
+    size_t w = word_index(ms, x);
+    uint64_t before = ms->live[w / WORD_BITS] &
+        (((uint64_t)1 << (w % WORD_BITS)) - 1);
+    return (VAL)(c->dest[w / WORD_BITS] +
+                 __builtin_popcountll(before) * WORD_BYTES);
+}
+
+// Find the next live closure at or after word 'w', if any.
+static VAL next_live(MarkSpace* ms, size_t* w) {
+    size_t words = (ms->hi - ms->lo) / WORD_BYTES;
+
+    while (*w < words) {
+        uint64_t bits = ms->live[*w / WORD_BITS] >> (*w % WORD_BITS);
+        if (bits != 0) {
+            *w += __builtin_ctzll(bits);
+            return *w < words ? (VAL)(ms->lo + *w * WORD_BYTES) : NULL;
+        }
+        *w = (*w / WORD_BITS + 1) * WORD_BITS;
+    }
+    return NULL;
+}
+
+static int is_young_space(Compactor* c, VAL x) {
+    MarkSpace* ms = find_space(c, x);
+    return ms != NULL && ms != &c->spaces[0];
+}
+
+// Point the fields of a live closure at where their referents will be,
+// returning whether any of them are young.
+static int update_fields(Compactor* c, VAL x) {
+    int i;
+    int young = 0;
+    VAL child;
+
+    switch(GETTY(x)) {
+    case CT_CON:
+        for(i = 0; i < CARITY(x); ++i) {
+            child = CARGS(x)[i];
+            young |= is_young_space(c, child);
+            SETARG(x, i, forward(c, child));
+        }
+        break;
+    case CT_STROFFSET:
+        child = x->info.str_offset->str;
+        young |= is_young_space(c, child);
+        x->info.str_offset->str = forward(c, child);
+        break;
+    case CT_STRCONCAT:
+        child = x->info.str_concat->left;
+        young |= is_young_space(c, child);
+        x->info.str_concat->left = forward(c, child);
+        child = x->info.str_concat->right;
+        young |= is_young_space(c, child);
+        x->info.str_concat->right = forward(c, child);
+        break;
+    case CT_BIGINT:
+        child = bigint_limbs(x);
+        if (child != NULL) {
+            mpz_t* big = (mpz_t*)x->info.ptr;
+            (*big)->_mp_d = (void*)((char*)forward(c, child) + sizeof(Closure));
+        }
+        break;
+    default:
+        break;
+    }
+    return young;
+}
+
+static void update_roots(Compactor* c) {
+    VM* vm = c->vm;
+    VAL* root;
 
+    for(root = vm->valstack; root < vm->valstack_top; ++root) {
+        *root = forward(c, *root);
+    }
 #ifdef HAS_PTHREAD
     Msg* msg;
 
     for(msg = vm->inbox; msg < vm->inbox_write; ++msg) {
-        msg->msg = copy(vm, msg->msg);
+        msg->msg = forward(c, msg->msg);
     }
 #endif
+    vm->ret = forward(c, vm->ret);
+    vm->reg1 = forward(c, vm->reg1);
+}
+
+// Update every live closure, recording (by new address) the compacted
+// ones which refer to young closures, since those still have to be
+// promoted.
+static void update_heap(Compactor* c) {
+    int i;
+
+    for (i = 0; i < c->nspaces; ++i) {
+        MarkSpace* ms = &c->spaces[i];
+        size_t w = 0;
+        VAL x;
+
+        while ((x = next_live(ms, &w)) != NULL) {
+            if (update_fields(c, x) && i == 0) {
+                c->stack[c->stack_size++] = forward(c, x);
+            }
+            w += CLOSURE_SIZE(x) / WORD_BYTES;
+        }
+    }
+}
+
+// Move every live closure to its new address, in address order so that
+// nothing is overwritten before it has been moved.
+static void slide(Compactor* c) {
+    MarkSpace* ms = &c->spaces[0];
+    size_t w = 0;
+    VAL x;
+
+    while ((x = next_live(ms, &w)) != NULL) {
+        size_t size = CLOSURE_SIZE(x);
+        VAL cl = forward(c, x);
+
+        w += size / WORD_BYTES;
+        if (cl != x) {
+            memmove(cl, x, size);
+            relocate(cl);
+        }
+        cl->hdr &= ~HDR_GC_MASK;
+    }
+}
+
+static size_t compact_gc(VM* vm) {
+    Generations* gen = &vm->gen;
+    Heap* h = gen->enabled ? &gen->old : &vm->heap;
+    Compactor c;
+    size_t i;
+
+    memset(&c, 0, sizeof(Compactor));
+    c.vm = vm;
+    add_mark_space(&c, h);
+    if (gen->enabled) {
+        add_mark_space(&c, &vm->heap);
+        add_mark_space(&c, &gen->survivor);
+    }
+
+    mark_roots(&c);
+
+    size_t live = live_bytes(&c.spaces[0]);
+    size_t young = 0;
+    for (i = 1; i < (size_t)c.nspaces; ++i) {
+        young += live_bytes(&c.spaces[i]);
+    }
+
+    // Slide in place, unless the heap has outgrown its region.
+    if (h->size < live + young) {
+        h->size = live + young;
+    }
+    size_t current = h->end - h->heap;
+    char* base = h->heap;
+    if (h->size > h->mapped) {
+        base = map_region(h->size);
+    }
+
+    compute_destinations(&c, base);
+    // The mark stack is empty, and has room for every young reference.
+    if (c.stack_capacity < live / sizeof(Closure) + 1) {
+        c.stack_capacity = live / sizeof(Closure) + 1;
+        c.stack = realloc(c.stack, c.stack_capacity * sizeof(VAL));
+        if (c.stack == NULL) {
+            fprintf(stderr, "RTS ERROR: Unable to grow the mark stack.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    update_roots(&c);
+    update_heap(&c);
+    slide(&c);
+
+    // Nothing refers to what was there before any more.
+    free_old_heap(h);
+    if (base != h->heap) {
+        unmap_region(h->heap, h->mapped);
+        h->heap = base;
+        h->mapped = region_size(h->size);
+    } else if (h->size < current) {
+        release_region(h->heap + h->size, current - h->size);
+    }
+    h->end = base + h->size;
+    h->next = base + live;
+    set_heap_limit(h);
+
+    if (gen->enabled) {
+        // Promote everything young, starting from whatever refers to it.
+        GC gc = { vm, {{0}}, 0, h, NULL, 0, 0 };
+        char* scan = h->next;
+
+        add_from_space(&gc, &vm->heap);
+        add_from_space(&gc, &gen->survivor);
+        flip_heap(&vm->heap);
+        flip_heap(&gen->survivor);
+
+        evacuate_roots(&gc);
+        for (i = 0; i < c.stack_size; ++i) {
+            scavenge(&gc, c.stack[i]);
+        }
+        cheney(&gc, h, scan);
+
+        gen->remembered.count = 0;
+        gen->remembered.untyped = false;
+    }
+
+    for (i = 0; i < (size_t)c.nspaces; ++i) {
+        free(c.spaces[i].live);
+    }
+    free(c.dest);
+    free(c.stack);
+
+    c_heap_sweep(&vm->c_heap);
+    large_heap_sweep(&vm->large_heap);
+    vm->live = used(h);
+    return live + young;
+}
+
+// Whether a major collection should compact rather than copy
+static int should_compact(VM* vm) {
+    if (heap_opts.compact) {
+        return 1;
+    }
+    return heap_opts.max_heap_size > 0 &&
+        vm->live * 100 > heap_opts.max_heap_size * heap_opts.compact_threshold;
+}
+
+/* *** Incremental collection ***
+ * With a pause budget (+RTS -I), a major collection of the old generation
+ * is spread over many short pauses. A cycle starts by flipping the old
+ * generation, promoting everything young into its new region and copying
+ * whatever the roots refer to, then after each minor collection scans a
+ * slice of the new region, Cheney-style, for as long as the budget
+ * allows. Each slice scans at least twice what the minor collection
+ * promoted, so that the cycle always finishes.
+ *
+ * Meanwhile the mutator must never see a closure which hasn't been
+ * copied, so every reference read out of a closure goes through the read
+ * barrier, which copies its target first. Closures promoted during the
+ * cycle are scanned like any other copied closure, and the young
+ * generation is scanned once at the end, so writes need no barrier.
+ */
+
+int idris_barrier = 0;
+
+#define INC_MIN_WORK 4096
+
+static GC inc_gc(VM* vm) {
+    Incremental* inc = &vm->gen.inc;
+    GC gc = { vm, {{ inc->from, inc->from_end }}, 1, &vm->gen.old, NULL, 0, 0 };
+    return gc;
+}
+
+// Whether the new region of the old generation certainly has room to
+// finish the cycle after the next minor collection.
+static int inc_has_room(VM* vm) {
+    Generations* gen = &vm->gen;
+    Incremental* inc = &gen->inc;
+    size_t remaining = (inc->from_end - inc->from) - inc->copied;
+
+    return (size_t)(gen->old.end - gen->old.next) >=
+        remaining + used(&vm->heap) + used(&gen->survivor);
+}
+
+static size_t inc_start(VM* vm) {
+    Generations* gen = &vm->gen;
+    Incremental* inc = &gen->inc;
+    Heap* old = &gen->old;
+    size_t young = used(&vm->heap) + used(&gen->survivor);
+    size_t i;
+
+    // Everything might survive, with room for promotions meanwhile.
+    if (old->size < used(old) + young + 2 * vm->heap.size) {
+        old->size = used(old) + young + 2 * vm->heap.size;
+    }
+    inc->from = old->heap;
+    inc->from_end = old->next;
+    inc->copied = 0;
+    flip_heap(old);
+
+    // Promote everything young. The remembered set refers to it from
+    // closures which may or may not survive; they keep the new references
+    // if they do.
+    GC promote = { vm, {{0}}, 0, old, NULL, 0, 0 };
+    add_from_space(&promote, &vm->heap);
+    add_from_space(&promote, &gen->survivor);
+    flip_heap(&vm->heap);
+    flip_heap(&gen->survivor);
 
-    vm->ret = copy(vm, vm->ret);
-    vm->reg1 = copy(vm, vm->reg1);
+    evacuate_roots(&promote);
+    for (i = 0; i < gen->remembered.count; ++i) {
+        scavenge(&promote, gen->remembered.items[i]);
+    }
+    cheney(&promote, old, old->heap);
+    gen->remembered.count = 0;
+
+    inc->scan = old->heap;
+    inc->active = true;
+    vm->large_heap.marking = true;
+    __atomic_add_fetch(&idris_barrier, 1, __ATOMIC_RELAXED);
+
+    GC gc = inc_gc(vm);
+    evacuate_roots(&gc);
+    inc->copied += gc.copied;
+    return promote.copied + gc.copied;
+}
 
-    cheney(vm);
+// Scan a closure, and mark what it owns outside the Idris heap, since a
+// minor collection won't have if it was promoted during the cycle.
+static void inc_scavenge(GC* gc, VAL heap_item) {
+    VAL limbs;
+
+    scavenge(gc, heap_item);
+    switch(GETTY(heap_item)) {
+    case CT_BIGINT:
+        limbs = bigint_limbs(heap_item);
+        if (limbs != NULL) {
+            mark_large(gc, limbs);
+        }
+        break;
+    case CT_CDATA:
+        c_heap_mark_item(heap_item->info.c_heap_item);
+        break;
+    case CT_STRING:
+        mark_str_index(gc, heap_item);
+        break;
+    default:
+        break;
+    }
+}
 
-    // After reallocation, if we've still more than half filled the new heap, grow the heap
-    // for next time.
+static size_t inc_finish(VM* vm) {
+    Generations* gen = &vm->gen;
+    Incremental* inc = &gen->inc;
+    GC gc = inc_gc(vm);
+    Heap* young[2] = { &vm->heap, &gen->survivor };
+    char* scan;
+    int i;
 
-    if ((vm->heap.next - vm->heap.heap) > vm->heap.size >> 1) {
-        vm->heap.size += vm->heap.growth;
+    // Young closures aren't scanned during the cycle.
+    evacuate_roots(&gc);
+    for (i = 0; i < 2; ++i) {
+        for (scan = young[i]->heap; scan < young[i]->next;
+             scan += CLOSURE_SIZE((VAL)scan)) {
+            inc_scavenge(&gc, (VAL)scan);
+        }
+    }
+    for (scan = inc->scan; scan < gen->old.next;
+         scan += CLOSURE_SIZE((VAL)scan)) {
+        inc_scavenge(&gc, (VAL)scan);
     }
 
-    // finally, sweep the C heap
+    inc->active = false;
+    vm->large_heap.marking = false;
+    __atomic_sub_fetch(&idris_barrier, 1, __ATOMIC_RELAXED);
+
     c_heap_sweep(&vm->c_heap);
+    large_heap_sweep(&vm->large_heap);
+    vm->live = used(&gen->old);
+    return gc.copied;
+}
+
+// Scan until the deadline, but at least 'work' bytes. Returns whether
+// the cycle is over.
+static int inc_slice(VM* vm, size_t work, clock_t deadline, size_t* copied) {
+    Incremental* inc = &vm->gen.inc;
+    Heap* old = &vm->gen.old;
+    GC gc = inc_gc(vm);
+    size_t scanned = 0;
+    int n = 0;
+
+    while (inc->scan < old->next) {
+        VAL heap_item = (VAL)inc->scan;
+        size_t size = CLOSURE_SIZE(heap_item);
+
+        inc_scavenge(&gc, heap_item);
+        inc->scan += size;
+        scanned += size;
+        if (scanned >= work && (++n & 63) == 0 && clock() >= deadline) {
+            break;
+        }
+    }
+    inc->copied += gc.copied;
+    *copied += gc.copied;
+
+    if (inc->scan < old->next) {
+        return 0;
+    }
+    *copied += inc_finish(vm);
+    return 1;
+}
+
+VAL idris_readBarrier(VAL* field) {
+    VM* vm = get_vm();
+    Incremental* inc = &vm->gen.inc;
+    VAL x = *field;
 
-    STATS_LEAVE_GC(vm->stats, vm->heap.size, vm->heap.next - vm->heap.heap)
+    if (!inc->active || x == NULL || ISIMM(x)) {
+        return x;
+    }
+    if ((char*)x >= inc->from && (char*)x < inc->from_end) {
+        GC gc = inc_gc(vm);
+        x = evacuate(&gc, x);
+        inc->copied += gc.copied;
+        *field = x;
+    } else if (x->hdr & LARGE) {
+        // It may end up only referred to from a closure already scanned.
+        large_heap_mark(x);
+    }
+    return x;
+}
+
+void idris_readBarrierArgs(VAL x, int num) {
+    int i;
+    for (i = 0; i < num; ++i) {
+        idris_readBarrier(&CARGS(x)[i]);
+    }
+}
+
+/* *** Heap sizing ***
+ * After a major collection, the size of the heap for next time is
+ * 'growth_factor' times what is live, so the heap shrinks back once a
+ * spike in live data is over. While major collections take more than
+ * 'gc_target' of the time, that is scaled up in proportion (by at most
+ * MAX_GC_SCALE), so that they happen less often. The heap never shrinks
+ * by more than half at once, and stays between the minimum and maximum
+ * heap sizes unless that would leave no room to allocate.
+ */
+#define MAX_GC_SCALE 4.0
+
+static void resize_heap(VM* vm, Heap* h, clock_t now) {
+    size_t live = used(h);
+    size_t current = h->end - h->heap;
+    double factor = heap_opts.growth_factor;
+    clock_t elapsed = now - vm->last_major;
+
+    if (elapsed > 0) {
+        double scale = (double)vm->gc_time / elapsed / heap_opts.gc_target;
+        if (scale > 1) {
+            factor *= scale < MAX_GC_SCALE ? scale : MAX_GC_SCALE;
+        }
+    }
+
+    size_t target = (size_t)(live * factor);
+    if (target < current / 2) {
+        target = current / 2;
+    }
+
+    if (heap_opts.max_heap_size > 0 && target > heap_opts.max_heap_size) {
+        target = heap_opts.max_heap_size;
+    }
+    if (target < heap_opts.min_heap_size) {
+        target = heap_opts.min_heap_size;
+    }
+
+    // Leave room for a nursery's worth of promotions, or for the heap
+    // to fill up by half again.
+    size_t room = vm->gen.enabled ? vm->heap.size : live / 2;
+    if (target < live + room) {
+        target = live + room;
+    }
+    h->size = ALIGN_CLOSURE(target);
+}
+
+static size_t heap_size(VM* vm) {
+    if (vm->gen.enabled) {
+        return vm->heap.size + vm->gen.survivor.size + vm->gen.old.size;
+    }
+    return vm->heap.size;
+}
+
+static size_t heap_occupied(VM* vm) {
+    if (vm->gen.enabled) {
+        return used(&vm->heap) + used(&vm->gen.survivor) + used(&vm->gen.old);
+    }
+    return used(&vm->heap);
+}
+
+static void collect(VM* vm, int full, int safe) {
+    Generations* gen = &vm->gen;
+    size_t copied = 0;
+    int major = 0;
+    int cycle_over = 0;
+    clock_t start = clock();
+    clock_t deadline = start +
+        (clock_t)((double)heap_opts.pause_budget * CLOCKS_PER_SEC / 1000000);
+
+    HEAP_CHECK(vm)
+    STATS_ENTER_GC(vm->stats, heap_size(vm))
+    if (idris_profiling) {
+        prof_flush(vm);
+    }
+
+    if (gen->inc.active && !full && !gen->remembered.untyped &&
+        inc_has_room(vm)) {
+        // Carry on with the incremental collection.
+        size_t promoted = used(&gen->old);
+        copied = minor_gc(vm);
+        vm->stats.minor_collections++;
+        promoted = used(&gen->old) - promoted;
+        cycle_over = inc_slice(vm, 2 * promoted + INC_MIN_WORK, deadline,
+                               &copied);
+    } else {
+        if (gen->inc.active) {
+            // It can't carry on, so finish it now.
+            copied = inc_finish(vm);
+            cycle_over = 1;
+        }
+
+        // A minor collection may have to promote everything which is young.
+        if (full || !gen->enabled || gen->remembered.untyped ||
+            large_heap_needs_gc(&vm->large_heap) ||
+            (size_t)(gen->old.end - gen->old.next) <
+                used(&vm->heap) + used(&gen->survivor)) {
+            if (heap_opts.pause_budget > 0 && gen->enabled && !full &&
+                !gen->remembered.untyped && !cycle_over) {
+                vm->gc_time = 0;
+                copied += inc_start(vm);
+                cycle_over = inc_slice(vm, INC_MIN_WORK, deadline, &copied);
+            } else if (safe && should_compact(vm)) {
+                copied += compact_gc(vm);
+                vm->stats.compactions++;
+                major = 1;
+            } else {
+                copied += major_gc(vm);
+                major = 1;
+            }
+        } else {
+            copied += minor_gc(vm);
+            vm->stats.minor_collections++;
+        }
+    }
+
+    // An incremental collection counts all its pauses, which might
+    // include other collections.
+    clock_t end = clock();
+    if (major) {
+        vm->gc_time = end - start;
+    } else if (gen->inc.active || cycle_over) {
+        vm->gc_time += end - start;
+    }
+    if (major || cycle_over) {
+        resize_heap(vm, gen->enabled ? &gen->old : &vm->heap, end);
+        idris_shrinkStack(vm);
+        vm->last_major = end;
+        if (idris_profiling) {
+            prof_census(vm);
+        }
+    }
+
+    STATS_LEAVE_GC(vm->stats, heap_size(vm), copied)
     HEAP_CHECK(vm)
 }
 
+void idris_gc(VM* vm) {
+    collect(vm, 0, 0);
+}
+
+void idris_fullGC(VM* vm) {
+    collect(vm, 1, 0);
+}
+
+void idris_safeGC(VM* vm, int full) {
+    collect(vm, full, 1);
+}
+
+void idris_finishIncremental(VM* vm) {
+    clock_t start, end;
+
+    if (!vm->gen.inc.active) {
+        return;
+    }
+    start = clock();
+    inc_finish(vm);
+    end = clock();
+    vm->gc_time += end - start;
+    resize_heap(vm, &vm->gen.old, end);
+    vm->last_major = end;
+}
+
+void* idris_allocTenured(VM* vm, size_t size) {
+    Heap* old = &vm->gen.old;
+
+    if (!fits(old, size)) {
+        // Even if everything survives, there will be room afterwards.
+        if (old->size < used(old) + size) {
+            old->size = used(old) + size + old->growth;
+        }
+        idris_fullGC(vm);
+    }
+
+    void* ptr = (void*)old->next;
+    old->next += size;
+    memset(ptr, 0, size);
+
+    // The caller fills in its fields without a write barrier, so they
+    // may well point into the nursery.
+    remset_add(&vm->gen.remembered, (VAL)ptr);
+    return ptr;
+}
+
 void idris_gcInfo(VM* vm, int doGC) {
     printf("Stack: <BOT %p> <TOP %p>\n", vm->valstack, vm->valstack_top);
-    printf("Final heap size         %zd\n", vm->heap.size);
-    printf("Final heap use          %zd\n", vm->heap.next - vm->heap.heap);
-    if (doGC) { idris_gc(vm); }
-    printf("Final heap use after GC %zd\n", vm->heap.next - vm->heap.heap);
+    printf("Final heap size         %zd\n", heap_size(vm));
+    printf("Final heap use          %zd\n", heap_occupied(vm));
+    if (doGC) { idris_fullGC(vm); }
+    printf("Final heap use after GC %zd\n", heap_occupied(vm));
+    printf("Large objects           %zd\n", vm->large_heap.size);
 #ifdef IDRIS_ENABLE_STATS
     printf("Total allocations       %" PRIu64 "\n", vm->stats.allocations);
 #endif
     printf("Number of collections   %" PRIu32 "\n", vm->stats.collections);
+    printf("Minor collections       %" PRIu32 "\n", vm->stats.minor_collections);
+    printf("Compacting collections  %" PRIu32 "\n", vm->stats.compactions);
 
 }
@@ -3,7 +3,19 @@
 
 #include "idris_rts.h"
 
+// Collect garbage; only the nursery if collecting generationally and
+// there is room to promote everything in it.
 void idris_gc(VM* vm);
+// Collect garbage in the whole heap.
+void idris_fullGC(VM* vm);
+// Collect garbage when nothing but the VM's roots refers to the heap,
+// which allows a major collection to compact rather than copy.
+void idris_safeGC(VM* vm, int full);
+// Finish the VM's incremental collection now, if it is part way through
+// one. Nothing the mutator can see is moved.
+void idris_finishIncremental(VM* vm);
+// Allocate a closure too big for the nursery in the old generation.
+void* idris_allocTenured(VM* vm, size_t size);
 void idris_gcInfo(VM* vm, int doGC);
 
 #endif
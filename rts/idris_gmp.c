@@ -4,6 +4,7 @@
 #else
 #include "mini-gmp.h"
 #endif
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -104,10 +105,13 @@ VAL MKBIGSI(VM* vm, signed long val) {
     return cl;
 }
 
+// Only collects if it has to allocate: the bigXXX operations call this
+// on their arguments after allocating their result, which a collection
+// would then leave behind.
 VAL GETBIG(VM * vm, VAL x) {
-    idris_requireAlloc(IDRIS_MAXGMP);
-
     if (ISINT(x)) {
+        idris_requireAlloc(IDRIS_MAXGMP);
+
         mpz_t* bigint;
         VAL cl = allocate(sizeof(Closure) + sizeof(mpz_t), 0);
         idris_doneAlloc();
@@ -121,7 +125,6 @@ VAL GETBIG(VM * vm, VAL x) {
 
         return cl;
     } else {
-        idris_doneAlloc();
         switch(GETTY(x)) {
         case CT_FWD:
             return GETBIG(vm, x->info.ptr);
@@ -383,6 +386,62 @@ int bigEqConst(VAL x, int c) {
     }
 }
 
+#define LIMB_BITS (sizeof(mp_limb_t) * CHAR_BIT)
+
+// Neither of these allocates, as mpz_get_str or a temporary mpz_t for the
+// constant would, so a case on a BigInt can't collect.
+
+int bigSmall(VAL x, int64_t* small) {
+    if (ISINT(x)) {
+        *small = (int64_t)GETINT(x);
+        return 1;
+    }
+    if (mpz_sizeinbase(GETMPZ(x), 2) > 63) {
+        return 0;
+    }
+    uint64_t mag = 0;
+    size_t k;
+    for (k = 0; k < mpz_size(GETMPZ(x)); ++k) {
+        mag |= (uint64_t)mpz_getlimbn(GETMPZ(x), k) << (k * LIMB_BITS);
+    }
+    *small = mpz_sgn(GETMPZ(x)) < 0 ? -(int64_t)mag : (int64_t)mag;
+    return 1;
+}
+
+int bigEqWords(VAL x, int sign, const uint32_t* words, size_t n) {
+    size_t k;
+    if (ISINT(x)) {
+        i_int v = GETINT(x);
+        if ((v > 0) - (v < 0) != sign) {
+            return 0;
+        }
+        uint64_t mag = v < 0 ? -(uint64_t)v : (uint64_t)v;
+        for (k = 0; k < n; ++k) {
+            if ((uint32_t)mag != words[k]) {
+                return 0;
+            }
+            mag >>= 32;
+        }
+        return mag == 0;
+    }
+    if (mpz_sgn(GETMPZ(x)) != sign) {
+        return 0;
+    }
+    if (sign == 0) {
+        return 1;
+    }
+    if ((mpz_sizeinbase(GETMPZ(x), 2) + 31) / 32 != n) {
+        return 0;
+    }
+    for (k = 0; k < n; ++k) {
+        mp_limb_t limb = mpz_getlimbn(GETMPZ(x), k * 32 / LIMB_BITS);
+        if ((uint32_t)(limb >> (k * 32 % LIMB_BITS)) != words[k]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 VAL bigEq(VM* vm, VAL x, VAL y) {
     return MKINT((i_int)(mpz_cmp(GETMPZ(x), GETMPZ(y)) == 0));
 }
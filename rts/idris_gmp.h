@@ -24,6 +24,12 @@ VAL idris_bigDivide(VM*, VAL x, VAL y);
 VAL idris_bigMod(VM*, VAL x, VAL y);
 
 int bigEqConst(VAL x, int c);
+// Whether x fits in 64 bits, when it is put in 'small', so that a case on
+// it can be a switch (see CONSTCASE in CodegenC)
+int bigSmall(VAL x, int64_t* small);
+// Whether x is the constant with the given sign (-1, 0 or 1) and the
+// magnitude in 'words', least significant first, with no leading zeros
+int bigEqWords(VAL x, int sign, const uint32_t* words, size_t n);
 
 VAL idris_bigEq(VM*, VAL x, VAL y);
 VAL idris_bigLt(VM*, VAL x, VAL y);
@@ -7,6 +7,21 @@
 #include <stdio.h>
 #include <assert.h>
 
+HeapOpts heap_opts = {
+    .nursery_size = 1048576,
+    .tenure_age   = 2,
+    .large_object_size = 4096,
+    .compact = false,
+    .compact_threshold = 30,
+    .min_heap_size = 0,
+    .max_heap_size = 0,
+    .growth_factor = 2.0,
+    .gc_target = 0.05,
+    .gc_threads = 1,
+    .pause_budget = 0,
+    .huge_pages = HUGE_PAGES_NONE
+};
+
 static void c_heap_free_item(CHeap * heap, CHeapItem * item)
 {
     assert(item->size <= heap->size);
@@ -53,6 +68,9 @@ void c_heap_insert_if_needed(VM * vm, CHeap * heap, CHeapItem * item)
     item->next = heap->first;
 
     heap->first = item;
+    if (vm->gen.inc.active) {
+        item->is_used = true;
+    }
 
     // at this point, links are done; let's calculate sizes
     
@@ -60,7 +78,7 @@ void c_heap_insert_if_needed(VM * vm, CHeap * heap, CHeapItem * item)
     if (heap->size >= heap->gc_trigger_size)
     {
         item->is_used = true;  // don't collect what we're inserting
-        idris_gc(vm);
+        idris_fullGC(vm);
     }
 }
 
@@ -106,17 +124,331 @@ void c_heap_destroy(CHeap * heap)
     }
 }
 
-/* Used for initializing the FP heap. */
-void alloc_heap(Heap * h, size_t heap_size, size_t growth, char * old)
+void large_heap_init(LargeHeap * heap)
+{
+    heap->first = NULL;
+    heap->size = 0;
+    heap->gc_trigger_size = LARGE_HEAP_GC_TRIGGER_SIZE(heap->size);
+    heap->marking = false;
+}
+
+static void large_heap_free_object(LargeHeap * heap, LargeObject * obj)
+{
+    assert(obj->size <= heap->size);
+    heap->size -= obj->size;
+
+    // fix links
+    if (obj->next != NULL)
+    {
+        obj->next->prev_next = obj->prev_next;
+    }
+    *(obj->prev_next) = obj->next;
+
+    free(obj);
+}
+
+void large_heap_destroy(LargeHeap * heap)
+{
+    while (heap->first != NULL)
+    {
+        large_heap_free_object(heap, heap->first);
+    }
+}
+
+void * large_heap_alloc(LargeHeap * heap, size_t size)
+{
+    LargeObject * obj = (LargeObject *) malloc(sizeof(LargeObject) + size);
+    if (obj == NULL) {
+        fprintf(stderr,
+                "RTS ERROR: Unable to allocate large object. Requested %zd bytes.\n",
+                size);
+        exit(EXIT_FAILURE);
+    }
+
+    obj->size = size;
+    obj->is_used = heap->marking;
+
+    if (heap->first != NULL)
+    {
+        heap->first->prev_next = &obj->next;
+    }
+    obj->prev_next = &heap->first;
+    obj->next = heap->first;
+    heap->first = obj;
+
+    heap->size += size;
+
+    memset(obj->data, 0, size);
+    ((Closure *) obj->data)->hdr = LARGE;
+    return obj->data;
+}
+
+void large_heap_mark(void * closure)
+{
+    LargeObject * obj = (LargeObject *)
+        ((char *) closure - offsetof(LargeObject, data));
+    obj->is_used = true;
+}
+
+void large_heap_sweep(LargeHeap * heap)
+{
+    LargeObject * p = heap->first;
+    while (p != NULL)
+    {
+        if (p->is_used)
+        {
+            p->is_used = false;
+            p = p->next;
+        }
+        else
+        {
+            LargeObject * unused_obj = p;
+            p = p->next;
+
+            large_heap_free_object(heap, unused_obj);
+        }
+    }
+
+    heap->gc_trigger_size = LARGE_HEAP_GC_TRIGGER_SIZE(heap->size);
+}
+
+bool large_heap_needs_gc(LargeHeap * heap)
+{
+    return heap->size >= heap->gc_trigger_size;
+}
+
+/* *** Regions ***
+ * Heap regions are mapped directly where possible, so that they can be
+ * kept for the whole run and their pages handed back when the heap
+ * shrinks. With huge pages, large regions are whole huge pages, aligned
+ * to one, so that scanning them takes fewer TLB entries.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+static size_t huge_page_size(void)
+{
+    static size_t size = 0;
+
+    if (size == 0) {
+        size = 2 << 20;
+#ifdef __linux__
+        FILE * f = fopen("/proc/meminfo", "r");
+        if (f != NULL) {
+            char line[128];
+            size_t kb;
+            while (fgets(line, sizeof(line), f) != NULL) {
+                if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+                    size = kb << 10;
+                    break;
+                }
+            }
+            fclose(f);
+        }
+#endif
+    }
+    return size;
+}
+
+static bool use_huge_pages(size_t size)
 {
-    char * mem = malloc(heap_size);
+#ifdef HAS_MMAP
+    return heap_opts.huge_pages != HUGE_PAGES_NONE
+        && size >= huge_page_size();
+#else
+    return false;
+#endif
+}
+
+size_t region_size(size_t size)
+{
+    if (use_huge_pages(size)) {
+        size_t huge = huge_page_size();
+        size = (size + huge - 1) & ~(huge - 1);
+    }
+    return size;
+}
+
+#ifdef HAS_MMAP
+static char * map_pages(size_t size, int flags)
+{
+    char * mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+// Maps 'size' bytes at a huge page boundary, and asks for them to be
+// backed by transparent huge pages.
+static char * map_aligned(size_t size)
+{
+    size_t huge = huge_page_size();
+    char * mem = map_pages(size + huge, 0);
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    uintptr_t start = ((uintptr_t)mem + huge - 1) & ~(huge - 1);
+    size_t head = start - (uintptr_t)mem;
+    if (head > 0) {
+        munmap(mem, head);
+    }
+    munmap((char *)start + size, huge - head);
+#ifdef MADV_HUGEPAGE
+    madvise((void *)start, size, MADV_HUGEPAGE);
+#endif
+    return (char *)start;
+}
+#endif
+
+char * map_region(size_t size)
+{
+#ifdef HAS_MMAP
+    char * mem = NULL;
+    size = region_size(size);
+
+    if (use_huge_pages(size)) {
+#ifdef MAP_HUGETLB
+        if (heap_opts.huge_pages == HUGE_PAGES_RESERVED) {
+            mem = map_pages(size, MAP_HUGETLB);
+        }
+#endif
+        if (mem == NULL) {
+            mem = map_aligned(size);
+        }
+    }
+    if (mem == NULL) {
+        mem = map_pages(size, 0);
+    }
+#else
+    char * mem = malloc(size);
+#endif
     if (mem == NULL) {
         fprintf(stderr,
                 "RTS ERROR: Unable to allocate heap. Requested %zd bytes.\n",
-                heap_size);
+                size);
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+void unmap_region(char * mem, size_t size)
+{
+#ifdef HAS_MMAP
+    munmap(mem, region_size(size));
+#else
+    free(mem);
+#endif
+}
+
+void release_region(char * mem, size_t size)
+{
+#ifdef HAS_MMAP
+    // Only whole huge pages, so as not to break them up.
+    size_t page = heap_opts.huge_pages != HUGE_PAGES_NONE
+        ? huge_page_size() : (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo = ((uintptr_t)mem + page - 1) & ~(page - 1);
+    uintptr_t hi = (uintptr_t)mem + size;
+
+    if (hi > lo) {
+        madvise((void *)lo, (hi - lo) & ~(page - 1), MADV_DONTNEED);
+    }
+#endif
+}
+
+/* *** Stacks ***
+ * A value stack is a region of address space reserved up front for the
+ * largest the stack may get, followed by a guard page. Only the part of
+ * it the stack has grown into is committed, so a generous maximum costs
+ * address space rather than memory.
+ */
+
+#ifdef HAS_MMAP
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+static size_t page_size(void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t stack_reservation(size_t size)
+{
+    size_t page = page_size();
+    return ((size + page - 1) & ~(page - 1)) + page;
+}
+#endif
+
+char * reserve_stack(size_t size)
+{
+#ifdef HAS_MMAP
+    char * mem = mmap(NULL, stack_reservation(size), PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = NULL;
+    }
+#else
+    char * mem = malloc(size);
+#endif
+    if (mem == NULL) {
+        fprintf(stderr,
+                "RTS ERROR: Unable to reserve stack. Requested %zd bytes.\n",
+                size);
         exit(EXIT_FAILURE);
     }
+    return mem;
+}
 
+void unreserve_stack(char * mem, size_t size)
+{
+#ifdef HAS_MMAP
+    munmap(mem, stack_reservation(size));
+#else
+    free(mem);
+#endif
+}
+
+size_t stack_commit_size(size_t size)
+{
+#ifdef HAS_MMAP
+    size_t page = page_size();
+    return (size + page - 1) & ~(page - 1);
+#else
+    return size;
+#endif
+}
+
+bool commit_stack(char * mem, size_t size)
+{
+#ifdef HAS_MMAP
+    return mprotect(mem, size, PROT_READ | PROT_WRITE) == 0;
+#else
+    return true;
+#endif
+}
+
+bool decommit_stack(char * mem, size_t size)
+{
+#ifdef HAS_MMAP
+    // Mapping it afresh drops both the pages and the commitment.
+    return mmap(mem, size, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                -1, 0) != MAP_FAILED;
+#else
+    return true;
+#endif
+}
+
+static void reset_heap(Heap * h, char * mem, size_t size)
+{
     h->heap = mem;
 #ifdef FORCE_ALIGNMENT
     if (((i_int)(h->heap)&1) == 1) {
@@ -126,20 +458,108 @@ void alloc_heap(Heap * h, size_t heap_size, size_t growth, char * old)
     {
         h->next = h->heap;
     }
-    h->end  = h->heap + heap_size;
+    h->end = h->heap + size;
+    set_heap_limit(h);
+}
+
+/* Used for initializing the FP heap. */
+void alloc_heap(Heap * h, size_t heap_size, size_t growth)
+{
+    h->mapped = region_size(heap_size);
+    reset_heap(h, map_region(heap_size), heap_size);
 
     h->size   = heap_size;
     h->growth = growth;
 
-    h->old = old;
+    h->old = NULL;
+    h->old_size = 0;
+    h->old_mapped = 0;
 }
 
 void free_heap(Heap * h) {
-    free(h->heap);
+    unmap_region(h->heap, h->mapped);
+    free_old_heap(h);
+}
 
+void free_old_heap(Heap * h) {
     if (h->old != NULL) {
-        free(h->old);
+        unmap_region(h->old, h->old_mapped);
     }
+    h->old = NULL;
+    h->old_size = 0;
+    h->old_mapped = 0;
+}
+
+void flip_heap(Heap * h) {
+    char * mem = h->old;
+    size_t mapped = h->old_mapped;
+
+    if (mem == NULL || mapped < h->size) {
+        free_old_heap(h);
+        mem = map_region(h->size);
+        mapped = region_size(h->size);
+    } else if (h->size < h->old_size) {
+        // The heap has shrunk: the rest of the region isn't needed.
+        release_region(mem + h->size, h->old_size - h->size);
+    }
+
+    h->old = h->heap;
+    h->old_size = h->end - h->heap;
+    h->old_mapped = h->mapped;
+
+    h->mapped = mapped;
+    reset_heap(h, mem, h->size);
+}
+
+void set_heap_limit(Heap * h) {
+    size_t reserve = 0;
+
+    if (heap_opts.compact || heap_opts.max_heap_size > 0) {
+        reserve = (h->end - h->heap) / 8;
+        if (reserve > 262144) {
+            reserve = 262144;
+        }
+    }
+    h->limit = h->end - reserve;
+}
+
+/* Used for initializing the generational part of the FP heap. The nursery
+ * itself is the VM's Heap. */
+void alloc_generations(Generations * gen, size_t old_size, size_t nursery_size)
+{
+    gen->enabled = true;
+    alloc_heap(&gen->old, old_size, old_size);
+    alloc_heap(&gen->survivor, nursery_size / 4, 0);
+
+    gen->remembered.items = NULL;
+    gen->remembered.count = 0;
+    gen->remembered.capacity = 0;
+    gen->remembered.untyped = false;
+
+    gen->inc.active = false;
+}
+
+void free_generations(Generations * gen)
+{
+    if (!gen->enabled) return;
+
+    free_heap(&gen->old);
+    free_heap(&gen->survivor);
+    free(gen->remembered.items);
+}
+
+void remset_add(RemSet * rs, Closure * item)
+{
+    if (rs->count == rs->capacity) {
+        rs->capacity = rs->capacity == 0 ? 1024 : rs->capacity * 2;
+        rs->items = realloc(rs->items, rs->capacity * sizeof(Closure *));
+        if (rs->items == NULL) {
+            fprintf(stderr, "RTS ERROR: Unable to grow the remembered set.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    item->hdr |= REMEMBERED;
+    rs->items[rs->count++] = item;
 }
 
 
@@ -162,13 +582,33 @@ void heap_check_overflow(Heap * heap) {
 }
 
 int is_valid_ref(VAL v) {
-    return (v != NULL) && !(ISINT(v));
+    return (v != NULL) && !(ISIMM(v));
 }
 
 int ref_in_heap(Heap * heap, VAL v) {
     return ((VAL)heap->heap <= v) && (v < (VAL)heap->next);
 }
 
+int ref_in_vm(VM * vm, VAL v) {
+    if (ref_in_heap(&vm->heap, v)) return 1;
+    if (vm->gen.enabled) {
+        Incremental* inc = &vm->gen.inc;
+        if (inc->active && (char*)v >= inc->from && (char*)v < inc->from_end) {
+            return 1;
+        }
+        return ref_in_heap(&vm->gen.survivor, v) || ref_in_heap(&vm->gen.old, v);
+    }
+    return 0;
+}
+
+int is_large_ref(VAL v) {
+    return (v->hdr & LARGE) != 0;
+}
+
+int is_static_ref(VAL v) {
+    return (v->hdr & IMMORTAL) != 0;
+}
+
 // Checks three important properties:
 // 1. Closure.
 //      Check if all pointers in the _heap_ points only to heap.
@@ -177,13 +617,11 @@ int ref_in_heap(Heap * heap, VAL v) {
 //      more recently allocated closure can point only to earlier allocated one.
 // 3. After gc there should be no forward references.
 //
-void heap_check_pointers(Heap * heap) {
+void heap_check_pointers(VM * vm, Heap * heap) {
     char* scan = NULL;
 
-    size_t item_size = 0;
-    for(scan = heap->heap; scan < heap->next; scan += item_size) {
-       item_size = *((size_t*)scan);
-       VAL heap_item = (VAL)(scan + sizeof(size_t));
+    for(scan = heap->heap; scan < heap->next; scan += CLOSURE_SIZE((VAL)scan)) {
+       VAL heap_item = (VAL)scan;
 
        switch(GETTY(heap_item)) {
        case CT_CON:
@@ -191,11 +629,12 @@ void heap_check_pointers(Heap * heap) {
              int ar = ARITY(heap_item);
              int i = 0;
              for(i = 0; i < ar; ++i) {
-                 VAL ptr = heap_item->info.c.args[i];
+                 VAL ptr = CARGS(heap_item)[i];
 
                  if (is_valid_ref(ptr)) {
                      // Check for closure.
-                     if (!ref_in_heap(heap, ptr)) {
+                     if (!ref_in_vm(vm, ptr) && !is_static_ref(ptr) &&
+                         !is_large_ref(ptr)) {
                          fprintf(stderr,
                                  "RTS ERROR: heap closure broken. "\
                                  "<HEAP %p %p %p> <REF %p>\n",
@@ -227,9 +666,18 @@ void heap_check_pointers(Heap * heap) {
     }
 }
 
-void heap_check_all(Heap * heap)
+void heap_check_space(VM * vm, Heap * heap)
 {
     heap_check_underflow(heap);
     heap_check_overflow(heap);
-    heap_check_pointers(heap);
+    heap_check_pointers(vm, heap);
+}
+
+void heap_check_all(VM * vm)
+{
+    heap_check_space(vm, &vm->heap);
+    if (vm->gen.enabled) {
+        heap_check_space(vm, &vm->gen.survivor);
+        heap_check_space(vm, &vm->gen.old);
+    }
 }
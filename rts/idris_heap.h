@@ -81,29 +81,219 @@ void c_heap_sweep(CHeap * c_heap);
 /// how big the item is for GC to work effectively.
 CHeapItem * c_heap_create_item(void * data, size_t size, CDataFinalizer * finalizer);
 
+/* *** Large object space ***
+ * Closures which hold no references to other closures (strings, raw
+ * data and managed pointers) and are at least 'large_object_size'
+ * bytes are allocated here, outside the Idris heap. They are never
+ * moved: a collection only marks them, and unmarked ones are freed
+ * by a sweep after each major collection.
+ *
+ * Like the C heap, it is implemented as a doubly linked list.
+ */
+
+#define LARGE_HEAP_GC_TRIGGER_SIZE(heap_size) \
+    (heap_size < 4194304 \
+        ? 8388608        \
+        : 2 * heap_size  \
+    )
+
+typedef struct LargeObject {
+    /// Size of the closure, in bytes.
+    size_t size;
+
+    /// The mark bit set by a major collection,
+    /// cleared by the sweep.
+    bool is_used;
+
+    /// Next object in the large object space.
+    struct LargeObject * next;
+
+    /// Pointer to the previous next-pointer.
+    struct LargeObject ** prev_next;
+
+    /// The closure itself.
+    char data[];
+} LargeObject;
+
+typedef struct LargeHeap {
+    /// The first object in the space. NULL if it is empty.
+    LargeObject * first;
+
+    /// Total size of the objects in the space.
+    size_t size;
+
+    /// When the space reaches this size, the next collection is a major one.
+    size_t gc_trigger_size;
+
+    /// Set while an incremental collection is under way, so that objects
+    /// allocated meanwhile survive its sweep.
+    bool marking;
+} LargeHeap;
+
+/// Create an empty large object space.
+void large_heap_init(LargeHeap * heap);
+
+/// Free all objects in the large object space.
+void large_heap_destroy(LargeHeap * heap);
+
+/// Allocate a zeroed closure of the given size. Never collects.
+void * large_heap_alloc(LargeHeap * heap, size_t size);
+
+/// Mark the given closure, which must be in a large object space, as used.
+void large_heap_mark(void * closure);
+
+/// Free all unmarked objects.
+void large_heap_sweep(LargeHeap * heap);
+
+/// Whether the space has grown enough to need a major collection.
+bool large_heap_needs_gc(LargeHeap * heap);
+
 /* *** Idris heap **
- * Objects without finalizers. Cheney-collected.
+ * Objects without finalizers. Cheney-collected, optionally with generations.
  */
 
+struct Closure;
+
 typedef struct {
     char*  next;   // Next allocated chunk. Should always (heap <= next < end).
     char*  heap;   // Point to bottom of heap
     char*  end;    // Point to top of heap
     size_t size;   // Size of _next_ heap. Size of current heap is /end - heap/.
     size_t growth; // Quantity of heap growth in bytes.
+    char*  limit;  // Generated code collects once allocation reaches this,
+                   // leaving the rest for primitives (see set_heap_limit).
+    size_t mapped; // Size of the region the current heap is in.
 
-    char* old;
+    char* old;     // Previous heap. Kept intact until the next collection, since
+                   // primitives may still hold pointers into it.
+    size_t old_size;   // Size of the previous heap.
+    size_t old_mapped; // Size of the region it is in.
 } Heap;
 
+/// Regions of memory for heaps, which stay mapped until unmapped
+/// however much of them is in use. 'release_region' hands the pages of
+/// part of one back to the OS, leaving it mapped. 'region_size' is the
+/// size of the region 'map_region' maps for a heap of the given size.
+size_t region_size(size_t size);
+char * map_region(size_t size);
+void unmap_region(char * mem, size_t size);
+void release_region(char * mem, size_t size);
 
-void alloc_heap(Heap * heap, size_t heap_size, size_t growth, char * old);
+/// Regions for value stacks: 'size' bytes of address space, of which
+/// parts are committed and decommitted as the stack grows and shrinks.
+/// Their ends must be at multiples of 'stack_commit_size', except at the
+/// end of the reservation. Without mmap, the whole stack is allocated
+/// at once and committing does nothing. Both return whether they worked.
+char * reserve_stack(size_t size);
+void unreserve_stack(char * mem, size_t size);
+size_t stack_commit_size(size_t size);
+bool commit_stack(char * mem, size_t size);
+bool decommit_stack(char * mem, size_t size);
+
+void alloc_heap(Heap * heap, size_t heap_size, size_t growth);
 void free_heap(Heap * heap);
+void free_old_heap(Heap * heap);
+
+/// Swap the current and previous regions of a heap, leaving the current
+/// region empty and 'size' bytes long. The previous region is reused if
+/// it is big enough. The region being swapped out is left intact.
+void flip_heap(Heap * heap);
+
+/// Reserve some of the heap for allocation from primitives when
+/// collections may compact, so that they are mostly started by generated
+/// code, where compacting is safe (see idris_safeGC).
+void set_heap_limit(Heap * heap);
+
+/* *** Generations ***
+ * When generational collection is enabled, the VM's Heap is the nursery
+ * and all allocation happens there. A minor collection evacuates the live
+ * part of the nursery only: objects which have survived 'tenure_age' minor
+ * collections are promoted to the old generation, younger ones are copied
+ * into a survivor space. The old generation is collected by a major
+ * collection, which evacuates everything.
+ *
+ * Objects in the old generation which may point into the young
+ * generation are recorded in the remembered set (see the write barrier
+ * in idris_rts.h).
+ */
+
+typedef struct {
+    /// Old objects which may point to young ones.
+    struct Closure ** items;
+    size_t count;
+    size_t capacity;
+
+    /// Set when an untyped pointer was written into the old generation
+    /// (see idris_pokePtr). The collector cannot know what such a write
+    /// refers to, so the next collection is a major one.
+    bool untyped;
+} RemSet;
+
+/// An incremental major collection (see idris_gc.c). The old generation
+/// is being copied out of [from, from_end) into its other region, and
+/// has been scanned up to 'scan'.
+typedef struct {
+    bool   active;
+    char*  from;
+    char*  from_end;
+    char*  scan;
+    size_t copied; // Bytes copied out of 'from' so far.
+} Incremental;
+
+typedef struct {
+    bool   enabled;
+    Heap   old;          // Tenured objects.
+    Heap   survivor;     // Young objects which have survived a minor collection.
+    RemSet remembered;
+    Incremental inc;
+} Generations;
+
+/// Pages to back heap regions with, where the OS has them. Regions of
+/// at least a huge page are rounded up to whole huge pages. Reserved
+/// ones (MAP_HUGETLB) fall back to transparent ones if none are free,
+/// and those to normal pages.
+#define HUGE_PAGES_NONE        0
+#define HUGE_PAGES_TRANSPARENT 1
+#define HUGE_PAGES_RESERVED    2
+
+/// The smallest nursery. A GMP operation needs 64K of it free (see
+/// IDRIS_MAXGMP in idris_gmp.c), which a smaller one could never have,
+/// so every operation would start a minor collection.
+#define MIN_NURSERY_SIZE 131072
+
+/// Heap tunables, shared by all VMs. Set from the RTS options before
+/// the first VM is created.
+typedef struct {
+    size_t nursery_size; // 0 disables generational collection, others
+                         // are at least MIN_NURSERY_SIZE.
+    int    tenure_age;   // Minor collections an object survives before promotion.
+    size_t large_object_size; // Smallest object put in the large object
+                              // space, 0 disables it.
+    bool   compact;           // Always compact in major collections.
+    int    compact_threshold; // Otherwise, compact once live data exceeds
+                              // this percentage of max_heap_size.
+    size_t min_heap_size;     // Major heap sizes, after a collection.
+    size_t max_heap_size;     // 0 if there is no limit.
+    double growth_factor;     // Heap size relative to live data.
+    double gc_target;         // Fraction of time the heap grows to stay under.
+    int    gc_threads;        // Threads copying in a major collection.
+    long   pause_budget;      // Microseconds per slice of an incremental
+                              // major collection, 0 for none.
+    int    huge_pages;        // One of HUGE_PAGES_*.
+} HeapOpts;
+
+extern HeapOpts heap_opts;
+
+void alloc_generations(Generations * gen, size_t old_size, size_t nursery_size);
+void free_generations(Generations * gen);
+
+void remset_add(RemSet * rs, struct Closure * item);
 
 
 #ifdef IDRIS_DEBUG
-void heap_check_all(Heap * heap);
+void heap_check_all(struct VM * vm);
 // Should be used _between_ gc's.
-#define HEAP_CHECK(vm) heap_check_all(&(vm->heap));
+#define HEAP_CHECK(vm) heap_check_all(vm);
 #else
 #define HEAP_CHECK(vm)
 #endif // IDRIS_DEBUG
@@ -2,10 +2,29 @@
 #include "idris_stats.h"
 #include "idris_rts.h"
 #include "idris_gmp.h"
+#include "idris_utf8.h"
+#include "idris_num.h"
+#include "idris_stdfgn.h"
 // The default options should give satisfactory results under many circumstances.
 RTSOpts opts = { 
     .init_heap_size = 16384000,
     .max_stack_size = 4096000,
+    .nursery_size   = 1048576,
+    .tenure_age     = 2,
+    .large_object_size = 4096,
+    .compact        = 0,
+    .compact_threshold = 30,
+    .min_heap_size  = 0,
+    .max_heap_size  = 0,
+    .growth_factor  = 2.0,
+    .gc_threads     = 1,
+    .pause_budget   = 0,
+    .huge_pages     = HUGE_PAGES_NONE,
+    .profile        = PROF_NONE,
+    .utf8_kernels   = UTF8_AUTO,
+    .num_libc       = 0,
+    .out_mode       = -1,
+    .out_size       = 0,
     .show_summary   = 0
 };
 
@@ -15,6 +34,40 @@ int main(int argc, char* argv[]) {
     __idris_argc = argc;
     __idris_argv = argv;
 
+    heap_opts.nursery_size = opts.nursery_size;
+    heap_opts.tenure_age = opts.tenure_age;
+    heap_opts.large_object_size = opts.large_object_size;
+    heap_opts.compact = opts.compact;
+    heap_opts.compact_threshold = opts.compact_threshold;
+    heap_opts.min_heap_size = opts.min_heap_size > 0 ? opts.min_heap_size
+                                                     : opts.init_heap_size;
+    heap_opts.max_heap_size = opts.max_heap_size;
+    // A minimum above the limit would stop the limit being enforced
+    if (heap_opts.max_heap_size > 0 &&
+        heap_opts.min_heap_size > heap_opts.max_heap_size) {
+        heap_opts.min_heap_size = heap_opts.max_heap_size;
+    }
+    heap_opts.growth_factor = opts.growth_factor;
+    heap_opts.gc_threads = opts.gc_threads;
+    heap_opts.pause_budget = opts.pause_budget;
+    heap_opts.huge_pages = opts.huge_pages;
+
+#ifndef IDRIS_PROFILE_SITES
+    if (opts.profile == PROF_SITE) {
+        fprintf(stderr, "RTS Opts: -hC needs a program compiled with "
+                        "-DIDRIS_PROFILE_SITES; profiling by type only.\n");
+        opts.profile = PROF_TYPE;
+    }
+#endif
+    prof_init(argv[0], opts.profile);
+    idris_utf8_select(opts.utf8_kernels);
+    idris_num_libc = opts.num_libc;
+    if (opts.out_mode >= 0 || opts.out_size > 0) {
+        idris_setBuffering(stdout, opts.out_mode >= 0 ? opts.out_mode
+                                                      : BUF_AUTO,
+                           (int)opts.out_size);
+    }
+
     VM* vm = init_vm(opts.max_stack_size, opts.init_heap_size, 1);
     init_threadkeys();
     init_threaddata(vm);
@@ -32,6 +85,7 @@ int main(int argc, char* argv[]) {
 #endif
 
     Stats stats = terminate(vm);
+    prof_finish();
 
     if (opts.show_summary) {
         print_stats(&stats);
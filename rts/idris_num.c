@@ -0,0 +1,380 @@
+#include "idris_num.h"
+#include "idris_num_tables.h"
+
+#include <string.h>
+
+int idris_num_libc = 0;
+
+/* *** Integers *** */
+
+static const char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+size_t idris_fmt_u64(char* buf, uint64_t v) {
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        uint64_t q = v / 100;
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + 2 * (v - q * 100), 2);
+        v = q;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + 2 * v, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return len;
+}
+
+size_t idris_fmt_i64(char* buf, int64_t v) {
+    if (v < 0) {
+        buf[0] = '-';
+        return 1 + idris_fmt_u64(buf + 1, -(uint64_t)v);
+    }
+    return idris_fmt_u64(buf, (uint64_t)v);
+}
+
+/* *** Writing doubles ***
+ * Following Ryu (Ulf Adams, PLDI 2018): the interval of reals which read
+ * back as the double is scaled by a power of 10, using 128 bit multiples
+ * of powers of 5 (see idris_num_tables.h), and digits are removed from its
+ * ends for as long as they differ.
+ */
+
+#define MANTISSA_BITS 52
+#define EXPONENT_BIAS 1023
+#define POW5_INV_BITS 125
+#define POW5_BITS 125
+
+// ceil(log2(5^e)), floor(log10(2^e)) and floor(log10(5^e)), for the
+// exponents doubles have
+static int pow5_bits(int e) {
+    return (int)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+static uint32_t log10_pow2(int e) {
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+static uint32_t log10_pow5(int e) {
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+static int multiple_of_pow5(uint64_t v, uint32_t p) {
+    uint32_t n = 0;
+    while (v % 5 == 0) {
+        v /= 5;
+        ++n;
+    }
+    return n >= p;
+}
+
+static int multiple_of_pow2(uint64_t v, uint32_t p) {
+    return (v & ((1ull << p) - 1)) == 0;
+}
+
+// (m * mul) >> j, for a 128 bit mul and 64 < j < 128
+static uint64_t mul_shift(uint64_t m, const uint64_t* mul, int j) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+    unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+    return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+#else
+    uint64_t m_lo = (uint32_t)m, m_hi = m >> 32;
+    uint64_t hi[2], lo[2];
+    int k;
+    for (k = 0; k < 2; ++k) {
+        uint64_t x_lo = (uint32_t)mul[k], x_hi = mul[k] >> 32;
+        uint64_t b00 = m_lo * x_lo, b01 = m_lo * x_hi;
+        uint64_t b10 = m_hi * x_lo, b11 = m_hi * x_hi;
+        uint64_t mid1 = b10 + (b00 >> 32);
+        uint64_t mid2 = b01 + (uint32_t)mid1;
+        hi[k] = b11 + (mid1 >> 32) + (mid2 >> 32);
+        lo[k] = (mid2 << 32) | (uint32_t)b00;
+    }
+    uint64_t sum = hi[0] + lo[1];
+    uint64_t high = hi[1] + (sum < hi[0]);
+    int dist = j - 64;
+    return (high << (64 - dist)) | (sum >> dist);
+#endif
+}
+
+// The shortest decimal digits * 10^e10 within the interval of a finite,
+// non-zero double with the given IEEE fields, and the closest such to it.
+static uint64_t shortest(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+                         int* e10) {
+    int e2;
+    uint64_t m2;
+    if (ieee_exponent == 0) {
+        e2 = 1 - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int)ieee_exponent - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = (1ull << MANTISSA_BITS) | ieee_mantissa;
+    }
+    int accept_bounds = (m2 & 1) == 0;
+
+    // The double, and the ends of its interval, are 4 * m2 and the points
+    // half way to its neighbours, which is closer below at a power of 2.
+    uint64_t mv = 4 * m2;
+    uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+    uint64_t vr, vp, vm;
+    int vm_trailing_zeros = 0;
+    int vr_trailing_zeros = 0;
+    if (e2 >= 0) {
+        uint32_t q = log10_pow2(e2) - (e2 > 3);
+        int k = POW5_INV_BITS + pow5_bits((int)q) - 1;
+        int i = -e2 + (int)q + k;
+        *e10 = (int)q;
+        vr = mul_shift(4 * m2, POW5_INV_SPLIT[q], i);
+        vp = mul_shift(4 * m2 + 2, POW5_INV_SPLIT[q], i);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, POW5_INV_SPLIT[q], i);
+        if (q <= 21) {
+            // Only then can one of them be a multiple of 10^q, and so
+            // scaled exactly.
+            if (mv % 5 == 0) {
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= multiple_of_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+        int i = -e2 - (int)q;
+        int k = pow5_bits(i) - POW5_BITS;
+        int j = (int)q - k;
+        *e10 = (int)q + e2;
+        vr = mul_shift(4 * m2, POW5_SPLIT[i], j);
+        vp = mul_shift(4 * m2 + 2, POW5_SPLIT[i], j);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, POW5_SPLIT[i], j);
+        if (q <= 1) {
+            vr_trailing_zeros = 1;
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1;
+            } else {
+                --vp;
+            }
+        } else if (q < 63) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    int removed = 0;
+    uint64_t last_removed = 0;
+    uint64_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        // Rarely, the ends of the interval need tracking exactly.
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                ++removed;
+            }
+        }
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+            last_removed = 4; // round half to even
+        }
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) ||
+                       last_removed >= 5);
+    } else {
+        int round_up = 0;
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+
+    *e10 += removed;
+    while (output % 10 == 0) {
+        output /= 10;
+        ++*e10;
+    }
+    return output;
+}
+
+size_t idris_fmt_double(char* buf, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint64_t ieee_mantissa = bits & ((1ull << MANTISSA_BITS) - 1);
+    uint32_t ieee_exponent = (uint32_t)(bits >> MANTISSA_BITS) & 0x7ff;
+    char* p = buf;
+    int k;
+
+    if (bits >> 63) {
+        *p++ = '-';
+    }
+    if (ieee_exponent == 0x7ff) {
+        memcpy(p, ieee_mantissa != 0 ? "nan" : "inf", 4);
+        return p + 3 - buf;
+    }
+    if (ieee_exponent == 0 && ieee_mantissa == 0) {
+        memcpy(p, "0", 2);
+        return p + 1 - buf;
+    }
+
+    int e10;
+    char digits[NUM_BUF_SIZE];
+    int n = (int)idris_fmt_u64(digits,
+                               shortest(ieee_mantissa, ieee_exponent, &e10));
+    // As %.16g would: the exponent of the first digit decides the layout
+    int x = e10 + n - 1;
+
+    if (x < -4 || x >= 16) {
+        *p++ = digits[0];
+        if (n > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, n - 1);
+            p += n - 1;
+        }
+        *p++ = 'e';
+        *p++ = x < 0 ? '-' : '+';
+        if (x > -10 && x < 10) {
+            *p++ = '0';
+        }
+        p += idris_fmt_u64(p, x < 0 ? -x : x);
+    } else if (x < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for (k = -1; k > x; --k) {
+            *p++ = '0';
+        }
+        memcpy(p, digits, n);
+        p += n;
+    } else if (x + 1 >= n) {
+        memcpy(p, digits, n);
+        p += n;
+        for (k = n; k <= x; ++k) {
+            *p++ = '0';
+        }
+    } else {
+        memcpy(p, digits, x + 1);
+        p += x + 1;
+        *p++ = '.';
+        memcpy(p, digits + x + 1, n - x - 1);
+        p += n - x - 1;
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+/* *** Reading doubles ***
+ * A decimal with at most 19 significant digits, whose value is at most
+ * 2^53 times a power of 10 no further from 1 than 10^22, is a double
+ * multiplied or divided by another, both exact, so one correctly rounded
+ * operation gives the correctly rounded result.
+ */
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(const char* p, const char* end) {
+    return p < end && *p >= '0' && *p <= '9';
+}
+
+int idris_parse_double(const char* s, size_t len, double* v) {
+    const char* end = s + len;
+    const char* p = s;
+    int negative = 0;
+    int any = 0;
+    int digits = 0;
+    int e10 = 0;
+    uint64_t m = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        return 0; // hexadecimal
+    }
+    for (; is_digit(p, end); ++p) {
+        any = 1;
+        if (m == 0 && *p == '0') {
+            continue;
+        }
+        if (++digits > 19) {
+            return 0;
+        }
+        m = m * 10 + (*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (++p; is_digit(p, end); ++p) {
+            any = 1;
+            --e10;
+            if (m == 0 && *p == '0') {
+                continue;
+            }
+            if (++digits > 19) {
+                return 0;
+            }
+            m = m * 10 + (*p - '0');
+        }
+    }
+    if (!any) {
+        return 0; // leading space, inf, nan or no number at all
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int negative_exp = 0;
+        int x = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negative_exp = *q++ == '-';
+        }
+        for (; is_digit(q, end); ++q) {
+            if (x > 1000) {
+                return 0;
+            }
+            x = x * 10 + (*q - '0');
+        }
+        e10 += negative_exp ? -x : x;
+    }
+
+    double d = (double)m;
+    if (m != 0) {
+        if (m > (1ull << 53) || e10 < -22 || e10 > 22) {
+            return 0;
+        }
+        d = e10 < 0 ? d / POW10[-e10] : d * POW10[e10];
+    }
+    *v = negative ? -d : d;
+    return 1;
+}
@@ -0,0 +1,31 @@
+#ifndef _IDRIS_NUM_H
+#define _IDRIS_NUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* *** Converting numbers to and from decimal ***
+ * Integers are written two digits at a time. Doubles are written with the
+ * fewest digits which read back as the same double (found as Ryu does),
+ * laid out as printf's %.16g would. Doubles are read directly when that is
+ * exact (as in Clinger's fast path), and by strtod otherwise.
+ */
+
+// The most any of the idris_fmt functions writes, with its NUL
+#define NUM_BUF_SIZE 32
+
+// Write v to buf, returning the number of characters written (not
+// counting the NUL)
+size_t idris_fmt_u64(char* buf, uint64_t v);
+size_t idris_fmt_i64(char* buf, int64_t v);
+size_t idris_fmt_double(char* buf, double v);
+
+// Read a double from the start of the first len bytes of s, as strtod
+// would, putting it in *v. Returns 0 if it can't do so exactly, for the
+// caller to use strtod instead.
+int idris_parse_double(const char* s, size_t len, double* v);
+
+// Convert with printf and strtod instead (see +RTS -n)
+extern int idris_num_libc;
+
+#endif
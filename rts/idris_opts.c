@@ -1,9 +1,13 @@
 #include "idris_opts.h"
+#include "idris_utf8.h"
+#include "idris_stdfgn.h"
 
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
 
 
 #define USAGE "\n"                                              \
@@ -13,40 +17,80 @@
     "  -s    Summary GC statistics.\n"                          \
     "  -H    Initial heap size. Egs: -H4M, -H500K, -H1G\n"      \
     "  -K    Sets the maximum stack size. Egs: -K8M\n"          \
+    "  -A    Nursery size, at least 128K, 0 disables generational\n" \
+    "        GC. Egs: -A1M\n"                                  \
+    "  -a    Minor GCs survived before promotion. Egs: -a2\n"  \
+    "  -L    Size from which strings and buffers are never moved by\n" \
+    "        the GC, 0 disables it. Egs: -L4K\n"               \
+    "  -c    Compact the heap in major GCs, rather than copy it.\n" \
+    "        With a percentage, only once live data exceeds that\n" \
+    "        much of the -M limit (default 30). Egs: -c, -c50\n" \
+    "  -m    Minimum heap size, by default the initial one. Egs: -m16M\n" \
+    "  -M    Maximum heap size, 0 for no limit. Egs: -M1G\n"   \
+    "  -F    Heap size relative to live data, grown by as much\n" \
+    "        again when GC time is high. Egs: -F2, -F1.5\n"   \
+    "  -g    Threads to copy with in major GCs. Egs: -g4\n"    \
+    "  -I    Collect the old generation incrementally, in pauses of\n" \
+    "        about this many microseconds. Egs: -I1000\n"      \
+    "  -P    Back large heaps with huge pages: transparent ones (-P),\n" \
+    "        or reserved ones, falling back to those (-Ph).\n" \
+    "  -h    Profile allocation by closure type (-hT), or by\n" \
+    "        allocating function too (-hC, if compiled with\n" \
+    "        -DIDRIS_PROFILE_SITES), and write a heap census\n" \
+    "        after each major GC to <prog>.hp.\n" \
+    "  -u    String operations to use, rather than the fastest the\n" \
+    "        CPU has: -uscalar, -usse2 or -uavx2.\n" \
+    "  -n    Convert numbers to and from strings with the C library\n" \
+    "        (-nlibc), as older versions did.\n" \
+    "  -b    Buffer standard output by line (-bl), by block (-bb),\n" \
+    "        writing only when the buffer is full or flushed, or not\n" \
+    "        at all (-bn). By default, by line only on a terminal.\n" \
+    "  -B    Standard output buffer size. Egs: -B64K\n"     \
     "\n"
 
 void print_usage(FILE * s) {
     fprintf(s, USAGE);
 }
 
-int read_size(char * str) {
-    int size = 0;
-    char mult = ' ';
+size_t read_size(char * str) {
+    unsigned long long size;
+    int shift = 0;
+    char * end;
 
-    int r = sscanf(str, "%u%c", &size, &mult);
+    errno = 0;
+    size = strtoull(str, &end, 10);
+    if (end == str || *str == '-') {
+        fprintf(stderr, "RTS Opts: Unable to parse size. Egs: 1K, 10M, 2G.\n");
+        print_usage(stderr);
+        exit(EXIT_FAILURE);
+    }
 
-    if (r == 1)
-        return size;
+    switch (*end) {
+    case '\0': break;
+    case 'K': shift = 10; ++end; break;
+    case 'M': shift = 20; ++end; break;
+    case 'G': shift = 30; ++end; break;
+    default:
+        fprintf(stderr,
+                "RTS Opts: Unable to recognize size suffix `%c'.\n" \
+                "          Possible suffixes are K or M or G.\n",
+                *end);
+        print_usage(stderr);
+        exit(EXIT_FAILURE);
+    }
 
-    if (r == 2) {
-        switch (mult) {
-        case 'K': size = size << 10; break;
-        case 'M': size = size << 20; break;
-        case 'G': size = size << 30; break;
-        default:
-            fprintf(stderr,
-                    "RTS Opts: Unable to recognize size suffix `%c'.\n" \
-                    "          Possible suffixes are K or M or G.\n",
-                    mult);
-            print_usage(stderr);
-            exit(EXIT_FAILURE);
-        }
-        return size;
+    if (*end != '\0') {
+        fprintf(stderr, "RTS Opts: Unable to parse size. Egs: 1K, 10M, 2G.\n");
+        print_usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    if (errno == ERANGE || size > (SIZE_MAX >> shift)) {
+        fprintf(stderr, "RTS Opts: Size `%s' is too large.\n", str);
+        exit(EXIT_FAILURE);
     }
 
-    fprintf(stderr, "RTS Opts: Unable to parse size. Egs: 1K, 10M, 2G.\n");
-    print_usage(stderr);
-    exit(EXIT_FAILURE);
+    return (size_t)size << shift;
 }
 
 
@@ -89,6 +133,125 @@ int parse_args(RTSOpts * opts, int argc, char *argv[])
             opts->max_stack_size = read_size(argv[i] + 2);
             break;
 
+        case 'A':
+            opts->nursery_size = read_size(argv[i] + 2);
+            break;
+
+        case 'a':
+            opts->tenure_age = atoi(argv[i] + 2);
+            break;
+
+        case 'L':
+            opts->large_object_size = read_size(argv[i] + 2);
+            break;
+
+        case 'c':
+            if (argv[i][2] == '\0') {
+                opts->compact = 1;
+            } else {
+                opts->compact_threshold = atoi(argv[i] + 2);
+            }
+            break;
+
+        case 'm':
+            opts->min_heap_size = read_size(argv[i] + 2);
+            break;
+
+        case 'M':
+            opts->max_heap_size = read_size(argv[i] + 2);
+            break;
+
+        case 'g':
+            opts->gc_threads = atoi(argv[i] + 2);
+            if (opts->gc_threads < 1) {
+                opts->gc_threads = 1;
+            }
+            break;
+
+        case 'I':
+            opts->pause_budget = atol(argv[i] + 2);
+            break;
+
+        case 'P':
+            if (argv[i][2] == '\0') {
+                opts->huge_pages = 1;
+            } else if (strcmp(argv[i] + 2, "h") == 0) {
+                opts->huge_pages = 2;
+            } else {
+                fprintf(stderr, "RTS Opts: Unknown huge page option `%s'.\n",
+                        argv[i]);
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'h':
+            if (strcmp(argv[i] + 2, "T") == 0) {
+                opts->profile = 1;
+            } else if (strcmp(argv[i] + 2, "C") == 0) {
+                opts->profile = 2;
+            } else {
+                fprintf(stderr, "RTS Opts: Unknown profiling option `%s'.\n",
+                        argv[i]);
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'u':
+            if (strcmp(argv[i] + 2, "scalar") == 0) {
+                opts->utf8_kernels = UTF8_SCALAR;
+            } else if (strcmp(argv[i] + 2, "sse2") == 0) {
+                opts->utf8_kernels = UTF8_SSE2;
+            } else if (strcmp(argv[i] + 2, "avx2") == 0) {
+                opts->utf8_kernels = UTF8_AVX2;
+            } else {
+                fprintf(stderr, "RTS Opts: Unknown string option `%s'.\n",
+                        argv[i]);
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'n':
+            if (strcmp(argv[i] + 2, "libc") == 0) {
+                opts->num_libc = 1;
+            } else {
+                fprintf(stderr, "RTS Opts: Unknown number option `%s'.\n",
+                        argv[i]);
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'b':
+            if (strcmp(argv[i] + 2, "l") == 0) {
+                opts->out_mode = BUF_LINE;
+            } else if (strcmp(argv[i] + 2, "b") == 0) {
+                opts->out_mode = BUF_BLOCK;
+            } else if (strcmp(argv[i] + 2, "n") == 0) {
+                opts->out_mode = BUF_NONE;
+            } else {
+                fprintf(stderr, "RTS Opts: Unknown buffering option `%s'.\n",
+                        argv[i]);
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'B':
+            opts->out_size = read_size(argv[i] + 2);
+            break;
+
+        case 'F':
+            opts->growth_factor = atof(argv[i] + 2);
+            if (opts->growth_factor <= 1) {
+                fprintf(stderr, "RTS Opts: -F must be greater than 1.\n");
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
         default:
             printf("RTS opts: Wrong argument: %s\n", argv[i]);
             print_usage(stderr);
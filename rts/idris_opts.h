@@ -7,6 +7,22 @@
 typedef struct {
     size_t init_heap_size;
     size_t max_stack_size;
+    size_t nursery_size;
+    int    tenure_age;
+    size_t large_object_size;
+    int    compact;
+    int    compact_threshold;
+    size_t min_heap_size;
+    size_t max_heap_size;
+    double growth_factor;
+    int    gc_threads;
+    long   pause_budget;
+    int    huge_pages; // 0 none, 1 transparent, 2 reserved (as HUGE_PAGES_*)
+    int    profile;    // 0 none, 1 by type, 2 by function too (as PROF_*)
+    int    utf8_kernels; // As UTF8_*
+    int    num_libc;   // Convert numbers with printf and strtod
+    int    out_mode;   // How stdout is buffered, or -1 (as BUF_*)
+    size_t out_size;   // Its buffer size, or 0 for the default
     int    show_summary;
 } RTSOpts;
 
@@ -0,0 +1,380 @@
+#include "idris_prof.h"
+#include "idris_rts.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+int idris_profiling = PROF_NONE;
+
+static FILE * census_file = NULL;
+static char * prof_prog = NULL;
+static clock_t prof_start;
+
+// What VMs which have terminated allocated.
+static ProfTable total_by_type;
+static ProfTable total_by_site;
+
+#ifdef HAS_PTHREAD
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+#define PROF_LOCK pthread_mutex_lock(&prof_lock);
+#define PROF_UNLOCK pthread_mutex_unlock(&prof_lock);
+#else
+#define PROF_LOCK
+#define PROF_UNLOCK
+#endif
+
+/* *** Tables ***
+ * Open addressing on the key, which is a site (a function name) or a
+ * type key (see type_key).
+ */
+
+static size_t slot(uintptr_t key, size_t capacity)
+{
+    uint64_t h = (uint64_t)key * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+static ProfEntry * table_find(ProfTable * t, uintptr_t key);
+
+static void table_grow(ProfTable * t)
+{
+    ProfEntry * old = t->entries;
+    size_t old_capacity = t->capacity;
+    size_t i;
+
+    t->capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+    t->entries = calloc(t->capacity, sizeof(ProfEntry));
+    if (t->entries == NULL) {
+        fprintf(stderr, "RTS ERROR: Unable to allocate profile.\n");
+        exit(EXIT_FAILURE);
+    }
+    t->count = 0;
+
+    for (i = 0; i < old_capacity; ++i) {
+        if (old[i].count > 0) {
+            *table_find(t, old[i].key) = old[i];
+        }
+    }
+    free(old);
+}
+
+// The entry for 'key', which is free if it is new.
+static ProfEntry * table_find(ProfTable * t, uintptr_t key)
+{
+    if ((t->count + 1) * 4 > t->capacity * 3) {
+        table_grow(t);
+    }
+    size_t i = slot(key, t->capacity);
+    while (t->entries[i].count > 0 && t->entries[i].key != key) {
+        i = (i + 1) & (t->capacity - 1);
+    }
+    if (t->entries[i].count == 0) {
+        t->entries[i].key = key;
+        t->count++;
+    }
+    return &t->entries[i];
+}
+
+static void table_add(ProfTable * t, uintptr_t key, uint64_t bytes,
+                      uint64_t count)
+{
+    ProfEntry * e = table_find(t, key);
+    e->bytes += bytes;
+    e->count += count;
+}
+
+static void table_merge(ProfTable * into, const ProfTable * t)
+{
+    size_t i;
+
+    for (i = 0; i < t->capacity; ++i) {
+        if (t->entries[i].count > 0) {
+            table_add(into, t->entries[i].key, t->entries[i].bytes,
+                      t->entries[i].count);
+        }
+    }
+}
+
+static void table_free(ProfTable * t)
+{
+    free(t->entries);
+    memset(t, 0, sizeof(ProfTable));
+}
+
+static int by_bytes(const void * x, const void * y)
+{
+    const ProfEntry * a = x;
+    const ProfEntry * b = y;
+    return a->bytes < b->bytes ? 1 : a->bytes > b->bytes ? -1 : 0;
+}
+
+// The entries in use, most bytes first. The caller frees them.
+static ProfEntry * table_sorted(const ProfTable * t)
+{
+    ProfEntry * sorted = malloc((t->count + 1) * sizeof(ProfEntry));
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < t->capacity; ++i) {
+        if (t->entries[i].count > 0) {
+            sorted[n++] = t->entries[i];
+        }
+    }
+    qsort(sorted, n, sizeof(ProfEntry), by_bytes);
+    return sorted;
+}
+
+/* *** Labels *** */
+
+static uintptr_t type_key(VAL x)
+{
+    uintptr_t ty = GETTY(x);
+    return ty == CT_CON ? ((uintptr_t)CTAG(x) << 8 | ty) : ty;
+}
+
+static const char * type_names[] = {
+    "Con", "Int", "BigInt", "Float", "String", "StrOffset", "StrConcat",
+    "Bits8", "Bits16", "Bits32", "Bits64", "Unit", "Ptr", "Fwd",
+    "ManagedPtr", "RawData", "CData"
+};
+
+static void type_label(uintptr_t key, char * buf, size_t len)
+{
+    uintptr_t ty = key & 0xff;
+
+    if (ty == CT_CON) {
+        snprintf(buf, len, "Con#%lu", (unsigned long)(key >> 8));
+    } else if (ty < sizeof(type_names) / sizeof(type_names[0])) {
+        snprintf(buf, len, "%s", type_names[ty]);
+    } else {
+        snprintf(buf, len, "Type#%lu", (unsigned long)ty);
+    }
+}
+
+// Undoes the name mangling of generated functions (see cname in
+// CodegenC.hs), in which anything but letters and digits is written as
+// its character code between underscores.
+static void site_label(uintptr_t key, char * buf, size_t len)
+{
+    const char * s = (const char *)key;
+    size_t n = 0;
+
+    if (s == NULL) {
+        snprintf(buf, len, "<rts>");
+        return;
+    }
+    if (strncmp(s, "_idris_", 7) == 0) {
+        s += 7;
+    }
+    while (*s != '\0' && n + 1 < len) {
+        if (*s == '_') {
+            char * end;
+            long c = strtol(s + 1, &end, 10);
+            if (*end != '_') {
+                break;
+            }
+            buf[n++] = c > 0 && c < 128 ? (char)c : '?';
+            s = end + 1;
+        } else {
+            buf[n++] = *s++;
+        }
+    }
+    buf[n] = '\0';
+}
+
+/* *** Allocation *** */
+
+void prof_vm_init(Profile * prof)
+{
+    memset(prof, 0, sizeof(Profile));
+}
+
+void prof_flush(VM * vm)
+{
+    Profile * prof = &vm->prof;
+
+    if (prof->pending != NULL) {
+        table_add(&prof->by_type, type_key((VAL)prof->pending),
+                  prof->pending_size, 1);
+        if (idris_profiling == PROF_SITE) {
+            table_add(&prof->by_site, (uintptr_t)prof->pending_site,
+                      prof->pending_size, 1);
+        }
+        prof->pending = NULL;
+    }
+}
+
+void idris_profAlloc(VM * vm, void * cl, size_t size)
+{
+    // Most closures are only given their type by the caller, after
+    // allocation, so each one is counted when the next is allocated.
+    prof_flush(vm);
+    vm->prof.pending = cl;
+    vm->prof.pending_size = size;
+    vm->prof.pending_site = vm->prof.site;
+}
+
+void prof_vm_done(VM * vm)
+{
+    if (idris_profiling == PROF_NONE) {
+        return;
+    }
+    prof_flush(vm);
+    PROF_LOCK
+    table_merge(&total_by_type, &vm->prof.by_type);
+    table_merge(&total_by_site, &vm->prof.by_site);
+    PROF_UNLOCK
+    table_free(&vm->prof.by_type);
+    table_free(&vm->prof.by_site);
+}
+
+/* *** Census *** */
+
+static void census_space(ProfTable * t, Heap * h)
+{
+    char * scan;
+    for (scan = h->heap; scan < h->next; scan += CLOSURE_SIZE((VAL)scan)) {
+        table_add(t, type_key((VAL)scan), CLOSURE_SIZE((VAL)scan), 1);
+    }
+}
+
+static double prof_time(void)
+{
+    return (double)(clock() - prof_start) / CLOCKS_PER_SEC;
+}
+
+static void write_sample(const ProfTable * t, double time)
+{
+    ProfEntry * sorted = table_sorted(t);
+    char label[64];
+    size_t i;
+
+    fprintf(census_file, "BEGIN_SAMPLE %.2f\n", time);
+    for (i = 0; i < t->count; ++i) {
+        type_label(sorted[i].key, label, sizeof(label));
+        fprintf(census_file, "%s\t%" PRIu64 "\n", label, sorted[i].bytes);
+    }
+    fprintf(census_file, "END_SAMPLE %.2f\n", time);
+    fflush(census_file);
+    free(sorted);
+}
+
+void prof_census(VM * vm)
+{
+    ProfTable t;
+    LargeObject * obj;
+
+    memset(&t, 0, sizeof(ProfTable));
+    census_space(&t, &vm->heap);
+    if (vm->gen.enabled) {
+        census_space(&t, &vm->gen.survivor);
+        census_space(&t, &vm->gen.old);
+    }
+    for (obj = vm->large_heap.first; obj != NULL; obj = obj->next) {
+        table_add(&t, type_key((VAL)obj->data), obj->size, 1);
+    }
+
+    PROF_LOCK
+    write_sample(&t, prof_time());
+    PROF_UNLOCK
+    table_free(&t);
+}
+
+/* *** Output *** */
+
+static FILE * open_output(const char * ext)
+{
+    size_t len = strlen(prof_prog) + strlen(ext) + 1;
+    char * name = malloc(len);
+    snprintf(name, len, "%s%s", prof_prog, ext);
+
+    FILE * f = fopen(name, "w");
+    if (f == NULL) {
+        fprintf(stderr, "RTS ERROR: Unable to open %s for profiling.\n",
+                name);
+        exit(EXIT_FAILURE);
+    }
+    free(name);
+    return f;
+}
+
+void prof_init(const char * prog, int mode)
+{
+    idris_profiling = mode;
+    if (mode == PROF_NONE) {
+        return;
+    }
+
+    const char * base = strrchr(prog, '/');
+    prof_prog = strdup(base != NULL ? base + 1 : prog);
+    prof_start = clock();
+
+    time_t now = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    census_file = open_output(".hp");
+    fprintf(census_file, "JOB \"%s\"\n", prof_prog);
+    fprintf(census_file, "DATE \"%s\"\n", date);
+    fprintf(census_file, "SAMPLE_UNIT \"seconds\"\n");
+    fprintf(census_file, "VALUE_UNIT \"bytes\"\n");
+    fprintf(census_file, "BEGIN_SAMPLE 0.00\nEND_SAMPLE 0.00\n");
+}
+
+static void write_table(FILE * f, const ProfTable * t, uint64_t total,
+                        void (*label_of)(uintptr_t, char *, size_t))
+{
+    ProfEntry * sorted = table_sorted(t);
+    char label[256];
+    size_t i;
+
+    fprintf(f, "%16s %12s %6s  %s\n", "bytes", "closures", "%", "");
+    for (i = 0; i < t->count; ++i) {
+        label_of(sorted[i].key, label, sizeof(label));
+        fprintf(f, "%16" PRIu64 " %12" PRIu64 " %6.2f  %s\n",
+                sorted[i].bytes, sorted[i].count,
+                total > 0 ? 100.0 * sorted[i].bytes / total : 0.0, label);
+    }
+    fprintf(f, "\n");
+    free(sorted);
+}
+
+void prof_finish(void)
+{
+    if (idris_profiling == PROF_NONE) {
+        return;
+    }
+
+    double end = prof_time();
+    fprintf(census_file, "BEGIN_SAMPLE %.2f\nEND_SAMPLE %.2f\n", end, end);
+    fclose(census_file);
+    census_file = NULL;
+
+    uint64_t bytes = 0;
+    uint64_t count = 0;
+    size_t i;
+    for (i = 0; i < total_by_type.capacity; ++i) {
+        bytes += total_by_type.entries[i].bytes;
+        count += total_by_type.entries[i].count;
+    }
+
+    FILE * f = open_output(".prof");
+    fprintf(f, "%s allocation profile (+RTS -h%c)\n\n", prof_prog,
+            idris_profiling == PROF_SITE ? 'C' : 'T');
+    fprintf(f, "Total: %" PRIu64 " bytes in %" PRIu64 " closures\n\n",
+            bytes, count);
+    fprintf(f, "By closure type:\n");
+    write_table(f, &total_by_type, bytes, type_label);
+    if (idris_profiling == PROF_SITE) {
+        fprintf(f, "By allocating function:\n");
+        write_table(f, &total_by_site, bytes, site_label);
+    }
+    fclose(f);
+
+    table_free(&total_by_type);
+    table_free(&total_by_site);
+    free(prof_prog);
+    prof_prog = NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef _IDRIS_PROF_H
+#define _IDRIS_PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* *** Heap profiling ***
+ * With +RTS -hT, allocation is counted by closure type (and constructor
+ * tag); with -hC, also by the generated function which allocated it, in
+ * a program compiled with IDRIS_PROFILE_SITES defined (see PROF_ENTER).
+ * After each major collection the live heap is counted by type and tag,
+ * and appended as a sample to <prog>.hp, in the format hp2ps plots.
+ * Allocation totals are written to <prog>.prof when the program exits.
+ */
+
+#define PROF_NONE 0
+#define PROF_TYPE 1
+#define PROF_SITE 2
+
+typedef struct {
+    uintptr_t key;
+    uint64_t  bytes;
+    uint64_t  count; // 0 if the entry is free
+} ProfEntry;
+
+typedef struct {
+    ProfEntry * entries;
+    size_t count;
+    size_t capacity; // A power of two
+} ProfTable;
+
+typedef struct {
+    ProfTable by_type;
+    ProfTable by_site;
+
+    /// The generated function running, set on entry and after each call
+    /// (see PROF_ENTER), which allocations are attributed to.
+    const char * site;
+
+    /// The last closure allocated, which is counted once it has been
+    /// given its type, at the next allocation or collection.
+    void * pending;
+    size_t pending_size;
+    const char * pending_site;
+} Profile;
+
+/// One of PROF_*. Set by prof_init before the first VM is created.
+extern int idris_profiling;
+
+struct VM;
+
+/// Start profiling in the given mode, writing to files named after 'prog'.
+void prof_init(const char * prog, int mode);
+/// Write the allocation totals and close the census.
+void prof_finish(void);
+
+void prof_vm_init(Profile * prof);
+/// Add a VM's allocation to the totals, when it terminates.
+void prof_vm_done(struct VM * vm);
+
+/// Count a closure which has just been allocated (see PROF_ALLOC).
+void idris_profAlloc(struct VM * vm, void * cl, size_t size);
+/// Count what is pending, before a collection moves it.
+void prof_flush(struct VM * vm);
+/// Take a census of the heap, after a major collection.
+void prof_census(struct VM * vm);
+
+#define PROF_ALLOC(vm, cl, size) \
+    do { \
+        if (idris_profiling) { idris_profAlloc(vm, cl, size); } \
+    } while (0)
+
+// Generated functions record which of them is running, for -hC, only in
+// programs compiled with IDRIS_PROFILE_SITES defined, so that otherwise
+// calls cost nothing extra.
+#ifdef IDRIS_PROFILE_SITES
+#define PROF_ENTER(vm) (vm)->prof.site = __func__
+#else
+#define PROF_ENTER(vm) ((void)0)
+#endif
+
+#endif // _IDRIS_PROF_H
@@ -4,8 +4,8 @@
 #include "idris_rts.h"
 #include "idris_gc.h"
 #include "idris_utf8.h"
+#include "idris_num.h"
 #include "idris_bitstring.h"
-#include "getline.h"
 
 #ifdef HAS_PTHREAD
 static pthread_key_t vm_key;
@@ -24,18 +24,34 @@ VM* init_vm(int stack_size, size_t heap_size,
     VM* vm = malloc(sizeof(VM));
     STATS_INIT_STATS(vm->stats)
     STATS_ENTER_INIT(vm->stats)
+    prof_vm_init(&vm->prof);
 
-    VAL* valstack = malloc(stack_size * sizeof(VAL));
+    // Reserved whole, committed as it grows (see idris_growStack).
+    VAL* valstack = (VAL*)reserve_stack(stack_size * sizeof(VAL));
 
     vm->active = 1;
     vm->valstack = valstack;
     vm->valstack_top = valstack;
     vm->valstack_base = valstack;
-    vm->stack_max = valstack + stack_size;
-
-    alloc_heap(&(vm->heap), heap_size, heap_size, NULL);
+    vm->stack_max = valstack;
+    vm->stack_limit = valstack + stack_size;
+    idris_growStack(vm, 0);
+
+    if (heap_opts.nursery_size > 0) {
+        size_t nursery = heap_opts.nursery_size < MIN_NURSERY_SIZE
+                       ? MIN_NURSERY_SIZE : heap_opts.nursery_size;
+        alloc_heap(&(vm->heap), nursery, 0);
+        alloc_generations(&(vm->gen), heap_size, nursery);
+    } else {
+        alloc_heap(&(vm->heap), heap_size, heap_size);
+        memset(&(vm->gen), 0, sizeof(Generations));
+    }
 
     c_heap_init(&vm->c_heap);
+    large_heap_init(&vm->large_heap);
+    vm->live = 0;
+    vm->gc_time = 0;
+    vm->last_major = clock();
 
     vm->ret = NULL;
     vm->reg1 = NULL;
@@ -124,9 +140,13 @@ Stats terminate(VM* vm) {
 #ifdef HAS_PTHREAD
     free(vm->inbox);
 #endif
-    free(vm->valstack);
+    prof_vm_done(vm);
+    unreserve_stack((char*)vm->valstack,
+                    (vm->stack_limit - vm->valstack) * sizeof(VAL));
     free_heap(&(vm->heap));
+    free_generations(&(vm->gen));
     c_heap_destroy(&(vm->c_heap));
+    large_heap_destroy(&(vm->large_heap));
 #ifdef HAS_PTHREAD
     pthread_mutex_destroy(&(vm -> inbox_lock));
     pthread_mutex_destroy(&(vm -> inbox_block));
@@ -154,6 +174,17 @@ CData cdata_manage(void * data, size_t size, CDataFinalizer finalizer)
     return c_heap_create_item(data, size, finalizer);
 }
 
+// Collect garbage, leaving room for 'size' more bytes in the heap even
+// if everything in it survives.
+static void collect_for(VM* vm, size_t size) {
+    size_t needed = (vm->heap.next - vm->heap.heap) + size;
+
+    if (!vm->gen.enabled && vm->heap.size <= needed) {
+        vm->heap.size = ALIGN_CLOSURE(needed + 1);
+    }
+    idris_gc(vm);
+}
+
 void idris_requireAlloc(size_t size) {
 #ifdef HAS_PTHREAD
     VM* vm = pthread_getspecific(vm_key);
@@ -162,7 +193,7 @@ void idris_requireAlloc(size_t size) {
 #endif
 
     if (!(vm->heap.next + size < vm->heap.end)) {
-        idris_gc(vm);
+        collect_for(vm, size);
     }
 #ifdef HAS_PTHREAD
     int lock = vm->processes > 0;
@@ -183,11 +214,28 @@ void idris_doneAlloc() {
 }
 
 int space(VM* vm, size_t size) {
-    return (vm->heap.next + size + sizeof(size_t) < vm->heap.end);
+    return (vm->heap.next + size < vm->heap.end);
+}
+
+static int is_large(size_t size) {
+    return heap_opts.large_object_size > 0 &&
+           size >= heap_opts.large_object_size;
 }
 
 void* idris_alloc(size_t size) {
-    Closure* cl = (Closure*) allocate(sizeof(Closure)+size, 0);
+    Closure* cl;
+    if (is_large(sizeof(Closure)+size)) {
+        // GMP calls this after idris_requireAlloc, so it mustn't collect.
+        // If the large object space grows too much, the next collection
+        // is a major one instead.
+        VM* vm = get_vm();
+        cl = (Closure*) large_heap_alloc(&vm->large_heap,
+                                         sizeof(Closure)+size);
+        cl->hdr |= PAYLOAD_HDR(size);
+        PROF_ALLOC(vm, cl, sizeof(Closure)+size);
+    } else {
+        cl = (Closure*) allocate(sizeof(Closure)+size, 0);
+    }
     SETTY(cl, CT_RAWDATA);
     cl->info.size = size;
     return (void*)cl+sizeof(Closure);
@@ -216,21 +264,33 @@ void* allocate(size_t size, int outerlock) {
     VM* vm = global_vm;
 #endif
 
-    if ((size & 7)!=0) {
-	size = 8 + ((size >> 3) << 3);
-    }
+    // There is no size stored with a closure: the header records the
+    // size of its payload, or its arity if it turns out to be a CT_CON.
+    size = ALIGN_CLOSURE(size);
+    assert(size >= sizeof(Closure));
 
-    size_t chunk_size = size + sizeof(size_t);
-
-    if (vm->heap.next + chunk_size < vm->heap.end) {
-        STATS_ALLOC(vm->stats, chunk_size)
-        void* ptr = (void*)(vm->heap.next + sizeof(size_t));
-        *((size_t*)(vm->heap.next)) = chunk_size;
-        vm->heap.next += chunk_size;
+    if (vm->heap.next + size < vm->heap.end) {
+        STATS_ALLOC(vm->stats, size)
+        Closure* ptr = (Closure*)(vm->heap.next);
+        vm->heap.next += size;
 
         assert(vm->heap.next <= vm->heap.end);
 
         memset(ptr, 0, size);
+        ptr->hdr = PAYLOAD_HDR(size - sizeof(Closure));
+        PROF_ALLOC(vm, ptr, size);
+#ifdef HAS_PTHREAD
+        if (lock) { // not message passing
+           pthread_mutex_unlock(&vm->alloc_lock);
+        }
+#endif
+        return ptr;
+    } else if (vm->gen.enabled && size >= vm->heap.size) {
+        // It will never fit in the nursery.
+        STATS_ALLOC(vm->stats, size)
+        Closure* ptr = idris_allocTenured(vm, size);
+        ptr->hdr |= PAYLOAD_HDR(size - sizeof(Closure));
+        PROF_ALLOC(vm, ptr, size);
 #ifdef HAS_PTHREAD
         if (lock) { // not message passing
            pthread_mutex_unlock(&vm->alloc_lock);
@@ -238,7 +298,7 @@ void* allocate(size_t size, int outerlock) {
 #endif
         return ptr;
     } else {
-        idris_gc(vm);
+        collect_for(vm, size);
 #ifdef HAS_PTHREAD
         if (lock) { // not message passing
            pthread_mutex_unlock(&vm->alloc_lock);
@@ -249,49 +309,319 @@ void* allocate(size_t size, int outerlock) {
 
 }
 
-/* Now a macro
-void* allocCon(VM* vm, int arity, int outer) {
-    Closure* cl = allocate(vm, sizeof(Closure) + sizeof(VAL)*arity,
-                               outer);
-    SETTY(cl, CT_CON);
+void* allocate_data(size_t size, int outerlock) {
+    if (!is_large(size)) {
+        return allocate(size, outerlock);
+    }
+
+#ifdef HAS_PTHREAD
+    VM* vm = pthread_getspecific(vm_key);
+    int lock = vm->processes > 0 && !outerlock;
+
+    if (lock) { // not message passing
+       pthread_mutex_lock(&vm->alloc_lock);
+    }
+#else
+    VM* vm = global_vm;
+#endif
+
+    // Large objects take no room in the Idris heap, so their space has to
+    // trigger collections of its own.
+    if (large_heap_needs_gc(&vm->large_heap)) {
+        idris_fullGC(vm);
+    }
 
-    cl -> info.c.arity = arity;
-//    cl -> info.c.tag = 42424242;
-//    printf("%p\n", cl);
-    return (void*)cl;
+    STATS_ALLOC(vm->stats, size)
+    Closure* ptr = large_heap_alloc(&vm->large_heap, size);
+    ptr->hdr |= PAYLOAD_HDR(size - sizeof(Closure));
+    PROF_ALLOC(vm, ptr, size);
+#ifdef HAS_PTHREAD
+    if (lock) { // not message passing
+       pthread_mutex_unlock(&vm->alloc_lock);
+    }
+#endif
+    return ptr;
 }
-*/
 
+VAL allocConSlow(VM* vm, uint32_t tag, int arity, int outerlock, int safe) {
+    if (safe && !outerlock && ALLOC_INLINE(vm) &&
+        vm->heap.next + CON_SIZE(arity) >= vm->heap.limit) {
+        idris_safeGC(vm, 0);
+    }
+    Closure* cl = allocate(CON_SIZE(arity), outerlock);
+    cl->hdr = (cl->hdr & HDR_GC_MASK) | CON_HDR(tag, arity);
+    return cl;
+}
+
+#ifdef IMMEDIATE_FLOAT
+VAL idris_boxFloat(VM* vm, double val) {
+#else
 VAL MKFLOAT(VM* vm, double val) {
+#endif
     Closure* cl = allocate(sizeof(Closure), 0);
     SETTY(cl, CT_FLOAT);
     cl -> info.f = val;
     return cl;
 }
 
-VAL MKSTR(VM* vm, const char* str) {
-    int len;
-    if (str == NULL) {
-        len = 0;
-    } else {
-        len = strlen(str)+1;
-    }
-    Closure* cl = allocate(sizeof(Closure) + // Type) + sizeof(char*) +
-                           sizeof(char)*len, 0);
+VAL idris_allocStr(VM* vm, size_t len, int outerlock) {
+    Closure* cl = allocate_data(sizeof(Closure) + sizeof(StrInfo) + len + 1,
+                                outerlock);
     SETTY(cl, CT_STRING);
-    cl -> info.str = (char*)cl + sizeof(Closure);
+    cl->info.str = (char*)(STRINFO(cl) + 1);
+    cl->info.str[len] = '\0';
+    STRINFO(cl)->len = len;
+    STRINFO(cl)->chars = STR_CHARS_UNKNOWN;
+    STRINFO(cl)->index = NULL;
+    STRINFO(cl)->hash = 0;
+    return cl;
+}
+
+VAL MKSTR(VM* vm, const char* str) {
     if (str == NULL) {
+        VAL cl = idris_allocStr(vm, 0, 0);
         cl->info.str = NULL;
-    } else {
-        strcpy(cl -> info.str, str);
+        STRINFO(cl)->chars = 0;
+        return cl;
     }
+    return MKSTRlen(vm, str, strlen(str));
+}
+
+VAL MKSTRlen(VM* vm, const char* str, size_t len) {
+    VAL cl = idris_allocStr(vm, len, 0);
+    memcpy(cl->info.str, str, len);
+    return cl;
+}
+
+// A string known to be ASCII, such as a number
+static VAL ascii_str(VM* vm, const char* str, int len) {
+    VAL cl = MKSTRlen(vm, str, len);
+    STRINFO(cl)->chars = len;
     return cl;
 }
 
 char* GETSTROFF(VAL stroff) {
     // Assume STROFF
     StrOffset* root = stroff->info.str_offset;
-    return (root->str->info.str + root->offset);
+    return (READ_BARRIER(root->str)->info.str + root->offset);
+}
+
+size_t GETSTROFFLEN(VAL stroff) {
+    return stroff->info.str_offset->len;
+}
+
+size_t idris_getStrLen(VAL str) {
+    if (GETTY(str) == CT_STRCONCAT) {
+        return str->info.str_concat->len;
+    }
+    return GETSTROFFLEN(str);
+}
+
+// Copies the characters of any kind of string to 'dst'. Only the shorter
+// side of a concatenation is copied recursively, so however lopsided a
+// rope is, the recursion is no deeper than log2 of its length.
+static void fill(VAL str, char* dst) {
+    while (GETTY(str) == CT_STRCONCAT) {
+        StrConcat* c = str->info.str_concat;
+        VAL l = READ_BARRIER(c->left);
+        if (c->right == NULL) {
+            str = l;
+            continue;
+        }
+        VAL r = READ_BARRIER(c->right);
+        size_t llen = GETSTRLEN(l);
+        if (llen < GETSTRLEN(r)) {
+            fill(l, dst);
+            str = r;
+            dst += llen;
+        } else {
+            fill(r, dst + llen);
+            str = l;
+        }
+    }
+    size_t len = GETSTRLEN(str);
+    if (len > 0) {
+        memcpy(dst, GETSTRBYTES(str), len);
+    }
+}
+
+// Allocate in the large object space, without collecting, as idris_alloc
+// does. If it grows too much, the next collection is a major one.
+static Closure* alloc_large_now(VM* vm, size_t size) {
+    Closure* cl = large_heap_alloc(&vm->large_heap, size);
+    cl->hdr |= PAYLOAD_HDR(size - sizeof(Closure));
+    STATS_ALLOC(vm->stats, size)
+    PROF_ALLOC(vm, cl, size);
+    return cl;
+}
+
+// A string which can't wait for a collection, since its caller is holding
+// on to other closures: if the nursery is full, it goes in the large
+// object space.
+static VAL alloc_str_now(VM* vm, size_t len) {
+    size_t size = sizeof(Closure) + sizeof(StrInfo) + len + 1;
+    if (is_large(size) || !space(vm, ALIGN_CLOSURE(size))) {
+        Closure* cl = alloc_large_now(vm, size);
+        SETTY(cl, CT_STRING);
+        cl->info.str = (char*)(STRINFO(cl) + 1);
+        cl->info.str[len] = '\0';
+        STRINFO(cl)->len = len;
+        STRINFO(cl)->chars = STR_CHARS_UNKNOWN;
+        STRINFO(cl)->index = NULL;
+        STRINFO(cl)->hash = 0;
+        return cl;
+    }
+    return idris_allocStr(vm, len, 0);
+}
+
+// How many bytes str has room for, not counting its NUL
+static size_t str_room(VAL str) {
+    return GETPAYLOAD(str) - sizeof(StrInfo) - 1;
+}
+
+// Ends a string made with room to spare after its first 'len' bytes. If it
+// was the last thing allocated in the nursery, the room is given back;
+// otherwise it is copied, unless the room is mostly used.
+static VAL trim_str(VM* vm, VAL str, size_t len) {
+    size_t room = str_room(str);
+    size_t size = sizeof(Closure) + sizeof(StrInfo) + len + 1;
+    int trimmed = 0;
+
+    STRINFO(str)->len = len;
+    str->info.str[len] = '\0';
+#ifdef HAS_PTHREAD
+    // Another thread may be copying a message into the nursery.
+    int lock = vm->processes > 0;
+    if (lock) {
+        pthread_mutex_lock(&vm->alloc_lock);
+    }
+#endif
+    if ((char*)str + CLOSURE_SIZE(str) == vm->heap.next) {
+        str->hdr = (str->hdr & (HDR_GC_MASK | 0xff)) |
+                   PAYLOAD_HDR(ALIGN_CLOSURE(size) - sizeof(Closure));
+        vm->heap.next = (char*)str + ALIGN_CLOSURE(size);
+        trimmed = 1;
+    }
+#ifdef HAS_PTHREAD
+    if (lock) {
+        pthread_mutex_unlock(&vm->alloc_lock);
+    }
+#endif
+    if (trimmed || room - len <= room / 4) {
+        return str;
+    }
+    VAL copy = alloc_str_now(vm, len);
+    memcpy(copy->info.str, str->info.str, len);
+    return copy;
+}
+
+// The flat string with the same characters as a rope. The rope keeps it,
+// so it is only copied once.
+static VAL flatten(VAL str) {
+    StrConcat* c = str->info.str_concat;
+    if (c->right != NULL) {
+        VM* vm = get_vm();
+        VAL flat = alloc_str_now(vm, c->len);
+        fill(str, flat->info.str);
+        STRINFO(flat)->chars = c->chars;
+        c->left = flat;
+        c->right = NULL;
+        WRITE_BARRIER(vm, str);
+    }
+    return READ_BARRIER(c->left);
+}
+
+// A slice which doesn't end where its root does is copied when it has to
+// end with a NUL. The copy becomes its root, so that only happens once.
+static char* terminate_slice(VAL str) {
+    StrOffset* off = str->info.str_offset;
+    VAL root = READ_BARRIER(off->str);
+    if (off->offset + off->len == STRINFO(root)->len) {
+        return root->info.str + off->offset;
+    }
+
+    VM* vm = get_vm();
+    VAL copy = alloc_str_now(vm, off->len);
+    memcpy(copy->info.str, root->info.str + off->offset, off->len);
+    off->str = copy;
+    off->offset = 0;
+    off->skipped = 0;
+    WRITE_BARRIER(vm, str);
+    return copy->info.str;
+}
+
+char* idris_getStr(VAL str) {
+    if (GETTY(str) == CT_STRCONCAT) {
+        return flatten(str)->info.str;
+    }
+    return terminate_slice(str);
+}
+
+char* idris_getStrBytes(VAL str) {
+    if (GETTY(str) == CT_STRCONCAT) {
+        return flatten(str)->info.str;
+    }
+    return GETSTROFF(str);
+}
+
+// Any kind of string which isn't a rope
+static VAL flat_str(VAL str) {
+    return GETTY(str) == CT_STRCONCAT ? flatten(str) : str;
+}
+
+// The CT_STRING which str is, or is a slice of, adding where the slice
+// starts to 'offset' (in bytes) and 'skipped' (in characters).
+static VAL str_root(VAL str, size_t* offset, size_t* skipped) {
+    str = flat_str(str);
+    if (GETTY(str) == CT_STROFFSET) {
+        *offset += str->info.str_offset->offset;
+        *skipped += str->info.str_offset->skipped;
+        str = READ_BARRIER(str->info.str_offset->str);
+    }
+    return str;
+}
+
+size_t idris_strChars(VAL str) {
+    if (ISSTR(str)) {
+        StrInfo* info = STRINFO(str);
+        if (info->chars == STR_CHARS_UNKNOWN) {
+            info->chars = idris_utf8_count(str->info.str, info->len);
+        }
+        return info->chars;
+    }
+    if (GETTY(str) == CT_STROFFSET) {
+        StrOffset* off = str->info.str_offset;
+        VAL root = READ_BARRIER(off->str);
+        if (off->offset + off->len == STRINFO(root)->len) {
+            return idris_strChars(root) - off->skipped;
+        }
+        return idris_utf8_count(root->info.str + off->offset, off->len);
+    }
+
+    // A rope; as in fill, only the shorter sides are counted recursively.
+    StrConcat* top = str->info.str_concat;
+    size_t chars = 0;
+    while (top->chars == STR_CHARS_UNKNOWN) {
+        StrConcat* c = str->info.str_concat;
+        VAL l = READ_BARRIER(c->left);
+        if (c->chars != STR_CHARS_UNKNOWN || c->right == NULL) {
+            top->chars = chars + (c->chars != STR_CHARS_UNKNOWN ?
+                                  c->chars : idris_strChars(l));
+            break;
+        }
+        VAL r = READ_BARRIER(c->right);
+        if (GETSTRLEN(l) < GETSTRLEN(r)) {
+            chars += idris_strChars(l);
+            str = r;
+        } else {
+            chars += idris_strChars(r);
+            str = l;
+        }
+        if (GETTY(str) != CT_STRCONCAT) {
+            top->chars = chars + idris_strChars(str);
+        }
+    }
+    return top->chars;
 }
 
 VAL MKCDATA(VM* vm, CHeapItem * item) {
@@ -318,8 +648,8 @@ VAL MKPTR(VM* vm, void* ptr) {
 }
 
 VAL MKMPTR(VM* vm, void* ptr, size_t size) {
-    Closure* cl = allocate(sizeof(Closure) +
-                           sizeof(ManagedPtr) + size, 0);
+    Closure* cl = allocate_data(sizeof(Closure) +
+                                sizeof(ManagedPtr) + size, 0);
     SETTY(cl, CT_MANAGEDPTR);
     cl->info.mptr = (ManagedPtr*)((char*)cl + sizeof(Closure));
     cl->info.mptr->data = (char*)cl + sizeof(Closure) + sizeof(ManagedPtr);
@@ -336,12 +666,9 @@ VAL MKFLOATc(VM* vm, double val) {
 }
 
 VAL MKSTRc(VM* vm, char* str) {
-    Closure* cl = allocate(sizeof(Closure) + // Type) + sizeof(char*) +
-                           sizeof(char)*strlen(str)+1, 1);
-    SETTY(cl, CT_STRING);
-    cl -> info.str = (char*)cl + sizeof(Closure);
-
-    strcpy(cl -> info.str, str);
+    size_t len = strlen(str);
+    VAL cl = idris_allocStr(vm, len, 1);
+    memcpy(cl->info.str, str, len);
     return cl;
 }
 
@@ -353,8 +680,8 @@ VAL MKPTRc(VM* vm, void* ptr) {
 }
 
 VAL MKMPTRc(VM* vm, void* ptr, size_t size) {
-    Closure* cl = allocate(sizeof(Closure) +
-                           sizeof(ManagedPtr) + size, 1);
+    Closure* cl = allocate_data(sizeof(Closure) +
+                                sizeof(ManagedPtr) + size, 1);
     SETTY(cl, CT_MANAGEDPTR);
     cl->info.mptr = (ManagedPtr*)((char*)cl + sizeof(Closure));
     cl->info.mptr->data = (char*)cl + sizeof(Closure) + sizeof(ManagedPtr);
@@ -363,6 +690,7 @@ VAL MKMPTRc(VM* vm, void* ptr, size_t size) {
     return cl;
 }
 
+#ifndef IMMEDIATE_BITS
 VAL MKB8(VM* vm, uint8_t bits8) {
     Closure* cl = allocate(sizeof(Closure), 1);
     SETTY(cl, CT_BITS8);
@@ -383,6 +711,7 @@ VAL MKB32(VM* vm, uint32_t bits32) {
     cl -> info.bits32 = bits32;
     return cl;
 }
+#endif
 
 VAL MKB64(VM* vm, uint64_t bits64) {
     Closure* cl = allocate(sizeof(Closure), 1);
@@ -413,17 +742,35 @@ void dumpVal(VAL v) {
         printf("%d ", (int)(GETINT(v)));
         return;
     }
+#ifdef IMMEDIATE_FLOAT
+    if (ISFLOAT(v)) {
+        printf("%g ", GETFLOAT(v));
+        return;
+    }
+#endif
+#ifdef IMMEDIATE_BITS
+    if (ISBITS(v)) {
+        printf("%u ", (unsigned)GETBITS32(v));
+        return;
+    }
+#endif
     switch(GETTY(v)) {
     case CT_CON:
         printf("%d[", TAG(v));
         for(i = 0; i < ARITY(v); ++i) {
-            dumpVal(v->info.c.args[i]);
+            dumpVal(GETARG(v, i));
         }
         printf("] ");
         break;
     case CT_STRING:
         printf("STR[%s]", v->info.str);
         break;
+    case CT_STRCONCAT:
+        printf("CONCAT[");
+        dumpVal(v->info.str_concat->left);
+        dumpVal(v->info.str_concat->right);
+        printf("] ");
+        break;
     case CT_FWD:
         printf("CT_FWD ");
         dumpVal((VAL)(v->info.ptr));
@@ -454,6 +801,12 @@ VAL idris_peekPtr(VM* vm, VAL ptr, VAL offset) {
 
 VAL idris_pokePtr(VAL ptr, VAL offset, VAL data) {
     void** addr = GETPTR(ptr) + GETINT(offset);
+    VM* vm = get_vm();
+    // We don't know what is being written, so if it's into the old
+    // generation, the next collection has to look at everything.
+    if (ISOLD(vm, addr)) {
+        vm->gen.remembered.untyped = true;
+    }
     *addr = GETPTR(data);
     return MKINT(0);
 }
@@ -481,116 +834,409 @@ void idris_memmove(void* dest, void* src, i_int dest_offset, i_int src_offset, i
 }
 
 VAL idris_castIntStr(VM* vm, VAL i) {
-    int x = (int) GETINT(i);
-    Closure* cl = allocate(sizeof(Closure) + sizeof(char)*16, 0);
-    SETTY(cl, CT_STRING);
-    cl -> info.str = (char*)cl + sizeof(Closure);
-    sprintf(cl -> info.str, "%d", x);
-    return cl;
+    char buf[NUM_BUF_SIZE];
+    if (idris_num_libc) {
+        return ascii_str(vm, buf, sprintf(buf, "%lld", (long long)GETINT(i)));
+    }
+    return ascii_str(vm, buf, idris_fmt_i64(buf, GETINT(i)));
 }
 
 VAL idris_castBitsStr(VM* vm, VAL i) {
-    Closure* cl;
-    ClosureType ty = i->ty;
+    char buf[NUM_BUF_SIZE];
+    uint64_t x;
+#ifdef IMMEDIATE_BITS
+    ClosureType ty = ISBITS(i) ? BITSTY(i) : GETTY(i);
+#else
+    ClosureType ty = GETTY(i);
+#endif
 
     switch (ty) {
     case CT_BITS8:
-        // max length 8 bit unsigned int str 3 chars (256)
-        cl = allocate(sizeof(Closure) + sizeof(char)*4, 0);
-        cl->info.str = (char*)cl + sizeof(Closure);
-        sprintf(cl->info.str, "%" PRIu8, (uint8_t)i->info.bits8);
+        x = GETBITS8(i);
         break;
     case CT_BITS16:
-        // max length 16 bit unsigned int str 5 chars (65,535)
-        cl = allocate(sizeof(Closure) + sizeof(char)*6, 0);
-        cl->info.str = (char*)cl + sizeof(Closure);
-        sprintf(cl->info.str, "%" PRIu16, (uint16_t)i->info.bits16);
+        x = GETBITS16(i);
         break;
     case CT_BITS32:
-        // max length 32 bit unsigned int str 10 chars (4,294,967,295)
-        cl = allocate(sizeof(Closure) + sizeof(char)*11, 0);
-        cl->info.str = (char*)cl + sizeof(Closure);
-        sprintf(cl->info.str, "%" PRIu32, (uint32_t)i->info.bits32);
+        x = GETBITS32(i);
         break;
     case CT_BITS64:
-        // max length 64 bit unsigned int str 20 chars (18,446,744,073,709,551,615)
-        cl = allocate(sizeof(Closure) + sizeof(char)*21, 0);
-        cl->info.str = (char*)cl + sizeof(Closure);
-        sprintf(cl->info.str, "%" PRIu64, (uint64_t)i->info.bits64);
+        x = i->info.bits64;
         break;
     default:
         fprintf(stderr, "Fatal Error: ClosureType %d, not an integer type", ty);
         exit(EXIT_FAILURE);
     }
 
-    SETTY(cl, CT_STRING);
-    return cl;
+    if (idris_num_libc) {
+        return ascii_str(vm, buf, sprintf(buf, "%" PRIu64, x));
+    }
+    return ascii_str(vm, buf, idris_fmt_u64(buf, x));
 }
 
+// Up to this many digits can't overflow a long, as strtol would
+#define SHORT_INT_DIGITS (sizeof(long) >= 8 ? 18 : 9)
+// The largest Int, which has one bit fewer than an i_int for the tag
+#define INT_MAX_VAL (INTPTR_MAX >> 1)
+
 VAL idris_castStrInt(VM* vm, VAL i) {
-    char *end;
-    i_int v = strtol(GETSTR(i), &end, 10);
-    if (*end == '\0' || *end == '\n' || *end == '\r')
-        return MKINT(v);
-    else
+    const char* s = GETSTRBYTES(i);
+    size_t len = GETSTRLEN(i);
+    size_t p = len > 0 && (s[0] == '-' || s[0] == '+');
+    size_t start = p;
+    i_int v = 0;
+
+    // Digits past SHORT_INT_DIGITS could overflow v, so they're only
+    // scanned to find where the number ends.
+    for (; p < len && s[p] >= '0' && s[p] <= '9'; ++p) {
+        if (p - start < SHORT_INT_DIGITS) v = v * 10 + (s[p] - '0');
+    }
+    if (!idris_num_libc && p > start && p - start <= SHORT_INT_DIGITS) {
+        // Otherwise, it may start with whitespace, which strtol skips, or
+        // overflow.
+        if (p == len || s[p] == '\0' || s[p] == '\n' || s[p] == '\r') {
+            return MKINT(s[0] == '-' ? -v : v);
+        }
         return MKINT(0);
+    }
+
+    char *end;
+    long l = strtol(GETSTR(i), &end, 10);
+    if (*end != '\0' && *end != '\n' && *end != '\r') return MKINT(0);
+    // Saturate, as strtol does, at the bounds of an Int
+    if (l > INT_MAX_VAL) return MKINT(INT_MAX_VAL);
+    if (l < -INT_MAX_VAL - 1) return MKINT(-INT_MAX_VAL - 1);
+    return MKINT((i_int)l);
 }
 
 VAL idris_castFloatStr(VM* vm, VAL i) {
-    Closure* cl = allocate(sizeof(Closure) + sizeof(char)*32, 0);
-    SETTY(cl, CT_STRING);
-    cl -> info.str = (char*)cl + sizeof(Closure);
-    snprintf(cl -> info.str, 32, "%.16g", GETFLOAT(i));
-    return cl;
+    char buf[NUM_BUF_SIZE];
+    if (idris_num_libc) {
+        return ascii_str(vm, buf, snprintf(buf, sizeof(buf), "%.16g", GETFLOAT(i)));
+    }
+    return ascii_str(vm, buf, idris_fmt_double(buf, GETFLOAT(i)));
 }
 
 VAL idris_castStrFloat(VM* vm, VAL i) {
-    return MKFLOAT(vm, strtod(GETSTR(i), NULL));
+    double v;
+    if (idris_num_libc || !idris_parse_double(GETSTRBYTES(i), GETSTRLEN(i), &v)) {
+        v = strtod(GETSTR(i), NULL);
+    }
+    return MKFLOAT(vm, v);
+}
+
+static size_t known_chars(VAL str) {
+    if (ISSTR(str)) {
+        return STRINFO(str)->chars;
+    }
+    if (GETTY(str) == CT_STRCONCAT) {
+        return str->info.str_concat->chars;
+    }
+    return STR_CHARS_UNKNOWN;
 }
 
+// The number of code points in both strings, if they are known already
+static size_t sum_chars(VAL l, VAL r) {
+    size_t lchars = known_chars(l);
+    size_t rchars = known_chars(r);
+    if (lchars == STR_CHARS_UNKNOWN || rchars == STR_CHARS_UNKNOWN) {
+        return STR_CHARS_UNKNOWN;
+    }
+    return lchars + rchars;
+}
+
+// Shorter concatenations are copied straight away.
+#define ROPE_MIN_LEN 128
+
 VAL idris_concat(VM* vm, VAL l, VAL r) {
-    char *rs = GETSTR(r);
-    char *ls = GETSTR(l);
-    // dumpVal(l);
-    // printf("\n");
-    Closure* cl = allocate(sizeof(Closure) + strlen(ls) + strlen(rs) + 1, 0);
-    SETTY(cl, CT_STRING);
-    cl -> info.str = (char*)cl + sizeof(Closure);
-    strcpy(cl -> info.str, ls);
-    strcat(cl -> info.str, rs);
+    size_t rlen = GETSTRLEN(r);
+    size_t llen = GETSTRLEN(l);
+    size_t chars = sum_chars(l, r);
+
+    if (llen == 0) {
+        return r;
+    }
+    if (rlen == 0) {
+        return l;
+    }
+    // If there's no room, copy it, or we'll have a problem after gc
+    // moves l and r
+    if (llen + rlen >= ROPE_MIN_LEN &&
+        space(vm, sizeof(Closure) + sizeof(StrConcat))) {
+        Closure* cl = allocate(sizeof(Closure) + sizeof(StrConcat), 0);
+        SETTY(cl, CT_STRCONCAT);
+        cl->info.str_concat = (StrConcat*)((char*)cl + sizeof(Closure));
+        cl->info.str_concat->left = l;
+        cl->info.str_concat->right = r;
+        cl->info.str_concat->len = llen + rlen;
+        cl->info.str_concat->chars = chars;
+        return cl;
+    }
+
+    char *rs = GETSTRBYTES(r);
+    char *ls = GETSTRBYTES(l);
+    VAL cl = idris_allocStr(vm, llen + rlen, 0);
+    memcpy(cl->info.str, ls, llen);
+    memcpy(cl->info.str + llen, rs, rlen);
+    STRINFO(cl)->chars = chars;
     return cl;
 }
 
 VAL idris_strlt(VM* vm, VAL l, VAL r) {
-    char *ls = GETSTR(l);
-    char *rs = GETSTR(r);
+    char *ls = GETSTRBYTES(l);
+    char *rs = GETSTRBYTES(r);
+    size_t llen = GETSTRLEN(l);
+    size_t rlen = GETSTRLEN(r);
 
-    return MKINT((i_int)(strcmp(ls, rs) < 0));
+    int cmp = memcmp(ls, rs, llen < rlen ? llen : rlen);
+    return MKINT((i_int)(cmp < 0 || (cmp == 0 && llen < rlen)));
 }
 
 VAL idris_streq(VM* vm, VAL l, VAL r) {
-    char *ls = GETSTR(l);
-    char *rs = GETSTR(r);
+    size_t llen = GETSTRLEN(l);
+
+    if (ISSTR(l) && ISSTR(r) && STRINFO(l)->hash != 0 && STRINFO(r)->hash != 0
+        && STRINFO(l)->hash != STRINFO(r)->hash) {
+        return MKINT(0);
+    }
+    return MKINT((i_int)(llen == GETSTRLEN(r) &&
+                         memcmp(GETSTRBYTES(l), GETSTRBYTES(r), llen) == 0));
+}
 
-    return MKINT((i_int)(strcmp(ls, rs) == 0));
+static uint32_t fnv1a(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t idris_strHash(VAL str) {
+    if (!ISSTR(str)) {
+        str = flat_str(str);
+        if (!ISSTR(str)) { // a slice, which has nowhere to keep it
+            return fnv1a(GETSTROFF(str), GETSTROFFLEN(str));
+        }
+    }
+    StrInfo* info = STRINFO(str);
+    if (info->hash != 0) {
+        return info->hash;
+    }
+    uint32_t h = fnv1a(str->info.str, info->len);
+    if (!(str->hdr & IMMORTAL)) {
+        // Literals are shared by every VM, so aren't written to.
+        info->hash = h;
+    }
+    return h;
 }
 
 VAL idris_strlen(VM* vm, VAL l) {
-    return MKINT((i_int)(idris_utf8_strlen(GETSTR(l))));
+    return MKINT((i_int)idris_strChars(l));
+}
+
+/* *** Reading lines ***
+ * Lines are read with fgets, which finds each newline by scanning the
+ * handle's stdio buffer, rather than with a call per character, and so
+ * that anything else reading the handle (fgetc, feof) sees the same
+ * buffer. They are read straight into the string which is returned,
+ * which is then trimmed to fit (see trim_str).
+ */
+
+#define READ_CHUNK 1024
+
+// Reads a line from f onto the end of *str, from 'used' bytes in, moving
+// it to a bigger string as it fills up. Returns where the line ends:
+// 'used' again at the end of the file.
+static size_t read_line(VM* vm, FILE* f, VAL* str, size_t used) {
+    char* buf;
+    char* nl;
+
+    for (;;) {
+        // fgets writes a NUL after the line, which may go in the NUL's
+        // place, so the string has room for one byte less than it is
+        // given.
+        size_t room = str_room(*str);
+        if (room + 1 - used < READ_CHUNK) {
+            size_t size = room * 2 > used + READ_CHUNK
+                        ? room * 2 : used + READ_CHUNK;
+            VAL grown = alloc_str_now(vm, size);
+            memcpy(grown->info.str, (*str)->info.str, used);
+            *str = grown;
+        }
+
+        // fgets doesn't say how much it read, and the line may contain
+        // NULs, so fill the chunk with newlines first. The first newline
+        // is then either the line's, followed by fgets' NUL, or just
+        // after that NUL.
+        buf = (*str)->info.str + used;
+        memset(buf, '\n', READ_CHUNK);
+        if (fgets(buf, READ_CHUNK, f) == NULL) {
+            return used;
+        }
+        nl = memchr(buf, '\n', READ_CHUNK);
+        if (nl == NULL) {
+            used += READ_CHUNK - 1; // the line goes on
+        } else if (nl + 1 < buf + READ_CHUNK && nl[1] == '\0') {
+            return used + (nl + 1 - buf);
+        } else {
+            return used + (nl - 1 - buf); // it ended with the file
+        }
+    }
 }
 
 VAL idris_readStr(VM* vm, FILE* h) {
-    VAL ret;
-    char *buffer = NULL;
-    size_t n = 0;
-    ssize_t len;
-    len = getline(&buffer, &n, h);
-    if (len <= 0) {
-        ret = MKSTR(vm, "");
-    } else {
-        ret = MKSTR(vm, buffer);
+    VAL str = idris_allocStr(vm, READ_CHUNK - 1, 0);
+    return trim_str(vm, str, read_line(vm, h, &str, 0));
+}
+
+VAL idris_readLines(VM* vm, void* h, int n) {
+    VAL str = idris_allocStr(vm, READ_CHUNK - 1, 0);
+    size_t used = 0;
+    size_t end;
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        end = read_line(vm, (FILE*)h, &str, used);
+        if (end == used) {
+            break;
+        }
+        used = end;
+    }
+    return trim_str(vm, str, used);
+}
+
+/* *** Writing strings ***
+ * A string is written under one lock on its handle, rather than one per
+ * piece of a rope. A long rope written to anything but a regular file (a
+ * terminal, pipe or socket, which have no position for stdio to keep
+ * track of) is written straight from its pieces with writev, rather than
+ * copied through the handle's buffer.
+ */
+
+#if (__linux__ || __APPLE__ || __FreeBSD__ || __DragonFly__)
+#define HAS_WRITEV
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+typedef struct iovec Piece;
+#define LOCK_FILE(f) flockfile(f);
+#define UNLOCK_FILE(f) funlockfile(f);
+#else
+typedef struct {
+    void* iov_base;
+    size_t iov_len;
+} Piece;
+#define LOCK_FILE(f)
+#define UNLOCK_FILE(f)
+#endif
+
+// Pieces gathered before they're written
+#define WRITE_BATCH 64
+// Ropes at least this long may be written with writev
+#define WRITEV_MIN 8192
+
+#ifdef HAS_WRITEV
+static int can_writev(FILE* f, VAL str) {
+    struct stat st;
+    return GETTY(str) == CT_STRCONCAT && GETSTRLEN(str) >= WRITEV_MIN &&
+           fstat(fileno(f), &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+static int write_vector(int fd, Piece* ps, int n) {
+    while (n > 0) {
+        ssize_t done = writev(fd, ps, n);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // Skip what was written, which may end part way through a piece
+        while (n > 0 && (size_t)done >= ps->iov_len) {
+            done -= ps->iov_len;
+            ++ps;
+            --n;
+        }
+        if (n > 0) {
+            ps->iov_base = (char*)ps->iov_base + done;
+            ps->iov_len -= done;
+        }
+    }
+    return 0;
+}
+#endif
+
+static int write_pieces(FILE* f, Piece* ps, int n, int vectored) {
+    int i;
+#ifdef HAS_WRITEV
+    if (vectored) {
+        return write_vector(fileno(f), ps, n);
+    }
+#endif
+    for (i = 0; i < n; ++i) {
+        if (fwrite(ps[i].iov_base, 1, ps[i].iov_len, f) != ps[i].iov_len) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int idris_writeStrVal(void* h, VAL str) {
+    FILE* f = (FILE*)h;
+    // The right hand sides of the ropes we're in the left of
+    VAL* pending = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    Piece batch[WRITE_BATCH];
+    int n = 0;
+    int vectored = 0;
+    int ret = 0;
+
+    LOCK_FILE(f)
+#ifdef HAS_WRITEV
+    if (can_writev(f, str)) {
+        // What's already buffered goes first
+        vectored = 1;
+        ret = fflush(f) == 0 ? 0 : -1;
+    }
+#endif
+    while (ret == 0) {
+        if (GETTY(str) == CT_STRCONCAT) {
+            StrConcat* c = str->info.str_concat;
+            if (c->right != NULL) {
+                if (count == capacity) {
+                    capacity = capacity == 0 ? 16 : capacity * 2;
+                    pending = realloc(pending, capacity * sizeof(VAL));
+                    if (pending == NULL) {
+                        fprintf(stderr, "RTS ERROR: Unable to write string.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                pending[count++] = READ_BARRIER(c->right);
+            }
+            str = READ_BARRIER(c->left);
+            continue;
+        }
+        size_t len = GETSTRLEN(str);
+        if (len > 0) {
+            batch[n].iov_base = (void*)GETSTRBYTES(str);
+            batch[n].iov_len = len;
+            if (++n == WRITE_BATCH) {
+                ret = write_pieces(f, batch, n, vectored);
+                n = 0;
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+        str = pending[--count];
+    }
+    if (ret == 0 && n > 0) {
+        ret = write_pieces(f, batch, n, vectored);
     }
-    free(buffer);
+    UNLOCK_FILE(f)
+    free(pending);
     return ret;
 }
 
@@ -603,8 +1249,10 @@ VAL MKSTROFFc(VM* vm, StrOffset* off) {
     SETTY(cl, CT_STROFFSET);
     cl->info.str_offset = (StrOffset*)((char*)cl + sizeof(Closure));
 
-    cl->info.str_offset->str = off->str;
+    cl->info.str_offset->str = READ_BARRIER(off->str);
     cl->info.str_offset->offset = off->offset;
+    cl->info.str_offset->skipped = off->skipped;
+    cl->info.str_offset->len = off->len;
 
     return cl;
 }
@@ -617,71 +1265,279 @@ VAL idris_strTail(VM* vm, VAL str) {
         SETTY(cl, CT_STROFFSET);
         cl->info.str_offset = (StrOffset*)((char*)cl + sizeof(Closure));
 
-        int offset = 0;
-        VAL root = str;
+        size_t offset = 0;
+        size_t skipped = 0;
+        VAL root = str_root(str, &offset, &skipped);
 
-        while(root!=NULL && !ISSTR(root)) { // find the root, carry on.
-                              // In theory, at most one step here!
-            offset += root->info.str_offset->offset;
-            root = root->info.str_offset->str;
+        // The tail of an empty string is empty.
+        size_t len = GETSTRLEN(str);
+        size_t first = len > 0 ? idris_utf8_charlen(GETSTRBYTES(str)) : 0;
+        if (first > len) {
+            first = len;
         }
-
         cl->info.str_offset->str = root;
-        cl->info.str_offset->offset = offset+idris_utf8_charlen(GETSTR(str));
+        cl->info.str_offset->offset = offset + first;
+        cl->info.str_offset->skipped = skipped + (first > 0);
+        cl->info.str_offset->len = len - first;
 
         return cl;
     } else {
-        char* nstr = GETSTR(str);
-        return MKSTR(vm, nstr+idris_utf8_charlen(nstr));
+        char* nstr = GETSTRBYTES(str);
+        size_t len = GETSTRLEN(str);
+        size_t first = len > 0 ? idris_utf8_charlen(nstr) : 0;
+        if (first > len) {
+            first = len;
+        }
+        return MKSTRlen(vm, nstr + first, len - first);
     }
 }
 
 VAL idris_strCons(VM* vm, VAL x, VAL xs) {
-    char *xstr = GETSTR(xs);
+    size_t xlen = GETSTRLEN(xs);
     int xval = GETINT(x);
+    VAL cl;
+
+    if (xlen >= ROPE_MIN_LEN) {
+        // Share xs rather than copying it, as long as that can be done
+        // without a collection moving it.
+        char init[4];
+        size_t ilen = idris_utf8_encode(xval, init);
+        if (space(vm, ALIGN_CLOSURE(sizeof(Closure) + sizeof(StrInfo) + ilen + 1)
+                      + sizeof(Closure) + sizeof(StrConcat))) {
+            cl = MKSTRlen(vm, init, ilen);
+            STRINFO(cl)->chars = 1;
+            return idris_concat(vm, cl, xs);
+        }
+    }
+
+    char *xstr = GETSTRBYTES(xs);
+    size_t chars = ISSTR(xs) ? STRINFO(xs)->chars : STR_CHARS_UNKNOWN;
     if ((xval & 0x80) == 0) { // ASCII char
-        Closure* cl = allocate(sizeof(Closure) +
-                               strlen(xstr) + 2, 0);
-        SETTY(cl, CT_STRING);
-        cl -> info.str = (char*)cl + sizeof(Closure);
+        cl = idris_allocStr(vm, xlen + 1, 0);
         cl -> info.str[0] = (char)(GETINT(x));
-        strcpy(cl -> info.str+1, xstr);
-        return cl;
+        memcpy(cl -> info.str+1, xstr, xlen);
     } else {
-        char *init = idris_utf8_fromChar(xval);
-        Closure* cl = allocate(sizeof(Closure) + strlen(init) + strlen(xstr) + 1, 0);
-        SETTY(cl, CT_STRING);
-        cl -> info.str = (char*)cl + sizeof(Closure);
-        strcpy(cl -> info.str, init);
-        strcat(cl -> info.str, xstr);
-        free(init);
-        return cl;
+        char init[4];
+        size_t ilen = idris_utf8_encode(xval, init);
+        cl = idris_allocStr(vm, ilen + xlen, 0);
+        memcpy(cl -> info.str, init, ilen);
+        memcpy(cl -> info.str + ilen, xstr, xlen);
+    }
+    if (chars != STR_CHARS_UNKNOWN) {
+        STRINFO(cl)->chars = chars + 1;
+    }
+    return cl;
+}
+
+/* *** String builders ***
+ * A builder is a constructor holding a CT_STRING with room to spare after
+ * its characters, which are appended in place, and whether that string
+ * has been handed out by idris_builderFreeze, after which it is never
+ * written to again. When the string runs out of room it is replaced by
+ * one twice the size, so appending costs amortised constant time a byte.
+ * Nothing here collects, so the closures given stay where they are.
+ */
+
+#define BUILDER_MIN 32
+
+// The builder's string, with room for 'more' bytes after its characters
+static VAL builder_reserve(VM* vm, VAL b, size_t more) {
+    VAL buf = GETARG(b, 0);
+    size_t len = STRINFO(buf)->len;
+    size_t room = str_room(buf);
+
+    int frozen = GETARG(b, 1) != MKINT(0);
+    if (!frozen && room - len >= more) {
+        return buf;
+    }
+    // A frozen string is copied to one as big, unless that's full too
+    size_t size = room - len >= more ? room
+                : room * 2 > len + more ? room * 2 : len + more;
+    VAL grown = alloc_str_now(vm, size < BUILDER_MIN ? BUILDER_MIN : size);
+    memcpy(grown->info.str, buf->info.str, len);
+    STRINFO(grown)->len = len;
+    SETARG(b, 0, grown);
+    SETARG(b, 1, MKINT(0));
+    WRITE_BARRIER(vm, b);
+    return grown;
+}
+
+VAL idris_builderNew(VM* vm, int capacity) {
+    VAL b;
+    idris_constructor(b, vm, 0, 2, 0);
+    VAL buf = alloc_str_now(vm, capacity < BUILDER_MIN ? BUILDER_MIN
+                                                       : (size_t)capacity);
+    STRINFO(buf)->len = 0;
+    SETARG(b, 0, buf);
+    SETARG(b, 1, MKINT(0));
+    return b;
+}
+
+void idris_builderAppendStr(VM* vm, VAL b, VAL str) {
+    size_t len = GETSTRLEN(str);
+    VAL buf = builder_reserve(vm, b, len);
+    fill(str, buf->info.str + STRINFO(buf)->len);
+    STRINFO(buf)->len += len;
+}
+
+void idris_builderAppendChar(VM* vm, VAL b, VAL c) {
+    VAL buf = builder_reserve(vm, b, 4);
+    char* end = buf->info.str + STRINFO(buf)->len;
+    STRINFO(buf)->len += idris_utf8_encode(GETINT(c), end);
+}
+
+void idris_builderAppendInt(VM* vm, VAL b, VAL i) {
+    VAL buf = builder_reserve(vm, b, NUM_BUF_SIZE);
+    char* end = buf->info.str + STRINFO(buf)->len;
+    STRINFO(buf)->len += idris_fmt_i64(end, GETINT(i));
+}
+
+void idris_builderAppendFloat(VM* vm, VAL b, VAL f) {
+    VAL buf = builder_reserve(vm, b, NUM_BUF_SIZE);
+    char* end = buf->info.str + STRINFO(buf)->len;
+    STRINFO(buf)->len += idris_fmt_double(end, GETFLOAT(f));
+}
+
+int idris_builderLength(VAL b) {
+    return (int)STRINFO(GETARG(b, 0))->len;
+}
+
+// The string itself is handed out if copying it would save little, or
+// can't save anything since it's a large object which is never moved.
+// Otherwise a copy of just its characters is.
+VAL idris_builderFreeze(VM* vm, VAL b) {
+    VAL buf = GETARG(b, 0);
+    size_t len = STRINFO(buf)->len;
+    size_t room = str_room(buf);
+
+    if ((buf->hdr & LARGE) || room - len <= room / 4) {
+        buf->info.str[len] = '\0';
+        SETARG(b, 1, MKINT(1));
+        return buf;
+    }
+    VAL str = alloc_str_now(vm, len);
+    memcpy(str->info.str, buf->info.str, len);
+    return str;
+}
+
+/* *** Character positions ***
+ * Finding the i'th character means counting them from the start, unless
+ * the string is known to be ASCII (when it has as many characters as
+ * bytes). Otherwise, once a string is indexed far enough into, it gets an
+ * index of where every STR_INDEX_STEP'th character starts, so that each
+ * lookup only counts from the nearest of those.
+ */
+
+#define STR_INDEX_STEP 128
+
+// The index is a CT_RAWDATA in the large object space, so building it
+// never collects; the GC keeps it as long as the string.
+static VAL build_index(VM* vm, VAL str) {
+    StrInfo* info = STRINFO(str);
+    size_t count = info->chars / STR_INDEX_STEP + 1;
+    size_t k;
+    Closure* cl = alloc_large_now(vm, sizeof(Closure) + count * sizeof(size_t));
+    SETTY(cl, CT_RAWDATA);
+    cl->info.size = count * sizeof(size_t);
+
+    size_t* offsets = (size_t*)(cl + 1);
+    const char* s = str->info.str;
+    const char* p = s;
+    offsets[0] = 0;
+    for (k = 1; k < count; ++k) {
+        p = idris_utf8_skip(p, info->len - (p - s), STR_INDEX_STEP);
+        offsets[k] = p - s;
+    }
+    return cl;
+}
+
+// Where the i'th character of a CT_STRING starts, or its end if it is
+// shorter
+static const char* str_char(VM* vm, VAL str, size_t i) {
+    StrInfo* info = STRINFO(str);
+    char* s = str->info.str;
+
+    if (i < STR_INDEX_STEP) {
+        return idris_utf8_skip(s, info->len, i);
+    }
+    if (idris_strChars(str) == info->len) {
+        return s + (i < info->len ? i : info->len);
     }
+    if (i >= info->chars) {
+        return s + info->len;
+    }
+    if (info->index == NULL) {
+        if (str->hdr & IMMORTAL) {
+            // Literals are shared by every VM, so none can own an index.
+            return idris_utf8_skip(s, info->len, i);
+        }
+        info->index = build_index(vm, str);
+    }
+    size_t at = ((size_t*)(info->index + 1))[i / STR_INDEX_STEP];
+    return idris_utf8_skip(s + at, info->len - at, i % STR_INDEX_STEP);
+}
+
+// The same for any kind of string, whose i'th character is found in the
+// CT_STRING it is part of, or its end if it is shorter.
+static const char* char_at(VM* vm, VAL str, i_int i) {
+    size_t offset = 0;
+    size_t skipped = 0;
+    size_t n = i > 0 ? (size_t)i : 0;
+    size_t len = GETSTRLEN(str);
+
+    VAL root = str_root(str, &offset, &skipped);
+    const char* end = root->info.str + offset + len;
+    const char* c = str_char(vm, root, skipped + n);
+    return c < end ? c : end;
 }
 
 VAL idris_strIndex(VM* vm, VAL str, VAL i) {
-    int idx = idris_utf8_index(GETSTR(str), GETINT(i));
-    return MKINT((i_int)idx);
+    const char* c = char_at(vm, str, GETINT(i));
+    if (c == GETSTRBYTES(str) + GETSTRLEN(str)) {
+        return MKINT(0); // a slice need not end with a NUL
+    }
+    return MKINT((i_int)idris_utf8_decode(c));
 }
 
+// Short substrings are copied, so that they don't keep a much longer
+// string alive.
+#define SLICE_MIN_LEN 32
+
 VAL idris_substr(VM* vm, VAL offset, VAL length, VAL str) {
-    char *start = idris_utf8_advance(GETSTR(str), GETINT(offset));
-    char *end = idris_utf8_advance(start, GETINT(length));
-    Closure* newstr = allocate(sizeof(Closure) + (end - start) +1, 0);
-    SETTY(newstr, CT_STRING);
-    newstr -> info.str = (char*)newstr + sizeof(Closure);
-    memcpy(newstr -> info.str, start, end - start);
-    *(newstr -> info.str + (end - start) + 1) = '\0';
-    return newstr;
+    i_int first = GETINT(offset) > 0 ? GETINT(offset) : 0;
+    i_int chars = GETINT(length) > 0 ? GETINT(length) : 0;
+    const char *start = char_at(vm, str, first);
+    const char *end = char_at(vm, str, first + chars);
+    size_t len = end - start;
+
+    if (len == GETSTRLEN(str)) {
+        return str;
+    }
+    if (len < SLICE_MIN_LEN || !space(vm, sizeof(Closure) + sizeof(StrOffset))) {
+        return MKSTRlen(vm, start, len);
+    }
+
+    size_t skipped = 0;
+    size_t root_offset = 0;
+    VAL root = str_root(str, &root_offset, &skipped);
+
+    Closure* cl = allocate(sizeof(Closure) + sizeof(StrOffset), 0);
+    SETTY(cl, CT_STROFFSET);
+    cl->info.str_offset = (StrOffset*)((char*)cl + sizeof(Closure));
+    cl->info.str_offset->str = root;
+    cl->info.str_offset->offset = start - root->info.str;
+    cl->info.str_offset->skipped = skipped + (size_t)first;
+    cl->info.str_offset->len = len;
+    return cl;
 }
 
 VAL idris_strRev(VM* vm, VAL str) {
-    char *xstr = GETSTR(str);
-    Closure* cl = allocate(sizeof(Closure) +
-                           strlen(xstr) + 1, 0);
-    SETTY(cl, CT_STRING);
-    cl->info.str = (char*)cl + sizeof(Closure);
-    idris_utf8_rev(xstr, cl->info.str);
+    char *xstr = GETSTRBYTES(str);
+    size_t len = GETSTRLEN(str);
+    size_t chars = ISSTR(str) ? STRINFO(str)->chars : STR_CHARS_UNKNOWN;
+    VAL cl = idris_allocStr(vm, len, 0);
+    idris_utf8_rev(xstr, len, cl->info.str);
+    STRINFO(cl)->chars = chars;
     return cl;
 }
 
@@ -728,7 +1584,7 @@ void* runThread(void* arg) {
 }
 
 void* vmThread(VM* callvm, func f, VAL arg) {
-    VM* vm = init_vm(callvm->stack_max - callvm->valstack, callvm->heap.size,
+    VM* vm = init_vm(callvm->stack_limit - callvm->valstack, callvm->heap.size,
                      callvm->max_threads);
     vm->processes=1; // since it can send and receive messages
     pthread_t t;
@@ -758,7 +1614,7 @@ VAL doCopyTo(VM* vm, VAL x) {
     int i, ar;
     VAL* argptr;
     Closure* cl;
-    if (x==NULL || ISINT(x)) {
+    if (x==NULL || ISIMM(x) || (x->hdr & IMMORTAL)) {
         return x;
     }
     switch(GETTY(x)) {
@@ -769,9 +1625,9 @@ VAL doCopyTo(VM* vm, VAL x) {
         } else {
             allocCon(cl, vm, CTAG(x), ar, 1);
 
-            argptr = (VAL*)(cl->info.c.args);
+            argptr = CARGS(cl);
             for(i = 0; i < ar; ++i) {
-                *argptr = doCopyTo(vm, *((VAL*)(x->info.c.args)+i)); // recursive version
+                *argptr = doCopyTo(vm, GETARG(x, i)); // recursive version
                 argptr++;
             }
         }
@@ -780,7 +1636,19 @@ VAL doCopyTo(VM* vm, VAL x) {
         cl = MKFLOATc(vm, x->info.f);
         break;
     case CT_STRING:
-        cl = MKSTRc(vm, x->info.str);
+        cl = idris_allocStr(vm, STRINFO(x)->len, 1);
+        memcpy(cl->info.str, x->info.str, STRINFO(x)->len);
+        STRINFO(cl)->chars = STRINFO(x)->chars;
+        break;
+    case CT_STROFFSET:
+        // Copy just the slice, not all of its root
+        cl = idris_allocStr(vm, GETSTROFFLEN(x), 1);
+        memcpy(cl->info.str, GETSTROFF(x), GETSTROFFLEN(x));
+        break;
+    case CT_STRCONCAT:
+        cl = idris_allocStr(vm, x->info.str_concat->len, 1);
+        fill(x, cl->info.str);
+        STRINFO(cl)->chars = x->info.str_concat->chars;
         break;
     case CT_BIGINT:
         cl = MKBIGMc(vm, x->info.ptr);
@@ -791,6 +1659,7 @@ VAL doCopyTo(VM* vm, VAL x) {
     case CT_MANAGEDPTR:
         cl = MKMPTRc(vm, x->info.mptr->data, x->info.mptr->size);
         break;
+#ifndef IMMEDIATE_BITS
     case CT_BITS8:
         cl = idris_b8CopyForGC(vm, x);
         break;
@@ -800,14 +1669,17 @@ VAL doCopyTo(VM* vm, VAL x) {
     case CT_BITS32:
         cl = idris_b32CopyForGC(vm, x);
         break;
+#endif
     case CT_BITS64:
         cl = idris_b64CopyForGC(vm, x);
         break;
     case CT_RAWDATA:
         {
-            size_t size = x->info.size + sizeof(Closure);
-            cl = allocate(size, 0);
-            memcpy(cl, x, size);
+            cl = allocate_data(x->info.size + sizeof(Closure), 0);
+            SETTY(cl, CT_RAWDATA);
+            cl->info.size = x->info.size;
+            memcpy((char*)cl + sizeof(Closure), (char*)x + sizeof(Closure),
+                   x->info.size);
         }
         break;
     default:
@@ -818,6 +1690,10 @@ VAL doCopyTo(VM* vm, VAL x) {
 
 VAL copyTo(VM* vm, VAL x) {
     VM* current = pthread_getspecific(vm_key);
+    // The read barrier works on the current VM, which is about to be the
+    // destination, so nothing of x's may be left to copy by the sender's
+    // incremental collection.
+    idris_finishIncremental(current);
     pthread_setspecific(vm_key, vm);
     VAL ret = doCopyTo(vm, x);
     pthread_setspecific(vm_key, current);
@@ -1013,8 +1889,7 @@ void init_nullaries() {
     nullary_cons = malloc(256 * sizeof(VAL));
     for(i = 0; i < 256; ++i) {
         cl = malloc(sizeof(Closure));
-        SETTY(cl, CT_CON);
-        cl->info.c.tag_arity = i << 8;
+        cl->hdr = CON_HDR(i, 0) | IMMORTAL;
         nullary_cons[i] = cl;
     }
 }
@@ -1039,6 +1914,56 @@ const char* idris_getArg(int i) {
 }
 
 void stackOverflow() {
-  fprintf(stderr, "Stack overflow");
+  fprintf(stderr, "Stack overflow (the limit can be raised with +RTS -K)\n");
   exit(-1);
 }
+
+// The stack is committed a chunk at a time, at least doubling when it
+// grows so that deep recursion commits it in few steps.
+#define STACK_CHUNK (64 * 1024)
+
+static size_t stack_commit(VM* vm, size_t values) {
+    size_t limit = vm->stack_limit - vm->valstack;
+    size_t bytes = values * sizeof(VAL);
+    if (bytes < STACK_CHUNK) {
+        bytes = STACK_CHUNK;
+    }
+    values = stack_commit_size(bytes) / sizeof(VAL);
+    return values < limit ? values : limit;
+}
+
+void idris_growStack(VM* vm, size_t x) {
+    size_t needed = (vm->valstack_top - vm->valstack) + x;
+    size_t committed = vm->stack_max - vm->valstack;
+
+    if (needed > (size_t)(vm->stack_limit - vm->valstack)) {
+        stackOverflow();
+    }
+    size_t target = stack_commit(vm, needed > 2 * committed ? needed : 2 * committed);
+    if (target > committed) {
+        if (!commit_stack((char*)vm->stack_max,
+                          (target - committed) * sizeof(VAL))) {
+            fprintf(stderr,
+                    "RTS ERROR: Unable to grow stack to %zd bytes.\n",
+                    target * sizeof(VAL));
+            exit(EXIT_FAILURE);
+        }
+        vm->stack_max = vm->valstack + target;
+    }
+}
+
+void idris_shrinkStack(VM* vm) {
+    // Values just above the top may have been written before a call, so
+    // a chunk beyond twice what is in use is kept.
+    size_t used = vm->valstack_top - vm->valstack;
+    size_t committed = vm->stack_max - vm->valstack;
+    size_t target = stack_commit(vm, 2 * used + STACK_CHUNK / sizeof(VAL));
+
+    // If it can't be decommitted, it stays committed, so it can still be
+    // used.
+    if (target < committed &&
+        decommit_stack((char*)(vm->valstack + target),
+                       (committed - target) * sizeof(VAL))) {
+        vm->stack_max = vm->valstack + target;
+    }
+}
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 #ifdef HAS_PTHREAD
 #include <pthread.h>
 #endif
@@ -15,6 +16,7 @@
 
 #include "idris_heap.h"
 #include "idris_stats.h"
+#include "idris_prof.h"
 
 #ifndef EXIT_SUCCESS
 #define EXIT_SUCCESS 0
@@ -26,22 +28,44 @@
 // Closures
 typedef enum {
     CT_CON, CT_INT, CT_BIGINT, CT_FLOAT, CT_STRING, CT_STROFFSET,
-    CT_BITS8, CT_BITS16, CT_BITS32, CT_BITS64, CT_UNIT, CT_PTR, CT_FWD,
+    CT_STRCONCAT, CT_BITS8, CT_BITS16, CT_BITS32, CT_BITS64, CT_UNIT, CT_PTR, CT_FWD,
     CT_MANAGEDPTR, CT_RAWDATA, CT_CDATA
 } ClosureType;
 
 typedef struct Closure *VAL;
 
-typedef struct {
-    uint32_t tag_arity;
-    VAL args[];
-} con;
-
+// A slice of a CT_STRING (its root), which keeps it alive, made by
+// strTail and substr rather than copying
 typedef struct {
     VAL str;
-    size_t offset;
+    size_t offset;  // In bytes
+    size_t skipped; // The same, in code points
+    size_t len;     // In bytes
 } StrOffset;
 
+// The length of a CT_STRING, which follows its Closure (see STRINFO), so
+// that nothing has to scan for the NUL which still ends the string.
+typedef struct {
+    size_t len;   // In bytes, not counting the NUL
+    size_t chars; // In code points, or STR_CHARS_UNKNOWN until first needed
+    VAL index;    // Where every so many code points start, once needed
+                  // (see idris_strIndex)
+    uint32_t hash; // Of its bytes, or 0 until first needed (see idris_strHash)
+} StrInfo;
+
+#define STR_CHARS_UNKNOWN ((size_t)-1)
+
+// A concatenation which hasn't been copied yet (a rope), so that building
+// a string up by appending to it isn't quadratic. It is flattened when
+// something needs its characters in one place (see GETSTR), after which
+// 'left' is the flat string and 'right' is NULL.
+typedef struct {
+    VAL left;
+    VAL right;
+    size_t len;   // In bytes
+    size_t chars; // In code points, or STR_CHARS_UNKNOWN
+} StrConcat;
+
 // A foreign pointer, managed by the idris GC
 typedef struct {
     size_t size;
@@ -49,18 +73,24 @@ typedef struct {
 } ManagedPtr;
 
 typedef struct Closure {
-// Use top 16 bits of ty for saying which heap value is in
-// Bottom 16 bits for closure type
+// A single header word, laid out as follows:
+//   bits  0-7   closure type
+//   bits  8-23  garbage collector bookkeeping (see GETAGE)
+//   bits 24-63  CT_CON: arity in bits 24-31 and tag in bits 32-63
+//               others: size of the payload after the Closure, in bytes
+// so the size of a closure can always be found from its header alone
+// (see CLOSURE_SIZE).
 //
-// NOTE: ty can not have type ClosureType because ty must be a
-// uint32_t but enum is platform dependent
-    uint32_t ty;
+// NOTE: hdr can not have type ClosureType because ty must be a
+// uint64_t but enum is platform dependent
+    uint64_t hdr;
+    // A CT_CON's arguments start here, in place of 'info' (see CARGS)
     union {
-        con c;
         int i;
         double f;
         char* str;
         StrOffset* str_offset;
+        StrConcat* str_concat;
         void* ptr;
         uint8_t bits8;
         uint16_t bits16;
@@ -72,6 +102,12 @@ typedef struct Closure {
     } info;
 } Closure;
 
+// A string literal, whose length is known at compile time (see STATIC_STR).
+typedef struct {
+    Closure closure;
+    StrInfo info;
+} StaticString;
+
 struct VM;
 
 struct Msg_t {
@@ -89,10 +125,16 @@ struct VM {
     VAL* valstack;
     VAL* valstack_top;
     VAL* valstack_base;
-    VAL* stack_max;
+    VAL* stack_max;   // End of the committed part of the stack
+    VAL* stack_limit; // End of the reserved part, which it can grow to
 
     CHeap c_heap;
-    Heap heap;
+    LargeHeap large_heap;
+    Heap heap; // The nursery, if collecting generationally
+    Generations gen;
+    size_t live; // Bytes live after the last major collection
+    clock_t gc_time; // How long it took
+    clock_t last_major; // When it finished
 #ifdef HAS_PTHREAD
     pthread_mutex_t inbox_lock;
     pthread_mutex_t inbox_block;
@@ -107,6 +149,7 @@ struct VM {
     int max_threads; // maximum number of threads to run in parallel
 #endif
     Stats stats;
+    Profile prof;
 
     VAL ret;
     VAL reg1;
@@ -178,32 +221,67 @@ typedef void(*func)(VM*, VAL*);
 #define ALIGN(__p, __alignment) ((__p + __alignment - 1) & ~(__alignment - 1))
 
 // Retrieving values
-#define GETSTR(x) (ISSTR(x) ? (((VAL)(x))->info.str) : GETSTROFF(x))
+// GETSTR flattens a rope, and copies a slice which doesn't end where its
+// root does, so that it ends with a NUL. That allocates but never
+// collects. GETSTRBYTES needs no NUL, so only flattens.
+#define GETSTR(x) (ISSTR(x) ? (((VAL)(x))->info.str) : idris_getStr((VAL)(x)))
+#define GETSTRBYTES(x) \
+    (ISSTR(x) ? (((VAL)(x))->info.str) : idris_getStrBytes((VAL)(x)))
+#define STRINFO(x) ((StrInfo*)((VAL)(x) + 1))
+// Length in bytes, for any kind of string
+#define GETSTRLEN(x) (ISSTR(x) ? STRINFO(x)->len : idris_getStrLen((VAL)(x)))
+// Whether a string is equal to the C string literal s, which may contain
+// NULs (see CONSTCASE in CodegenC)
+#define STREQLIT(x, s) (GETSTRLEN(x) == sizeof(s) - 1 && \
+                        memcmp(GETSTRBYTES(x), (s), sizeof(s) - 1) == 0)
 #define GETPTR(x) (((VAL)(x))->info.ptr)
 #define GETMPTR(x) (((VAL)(x))->info.mptr->data)
-#define GETFLOAT(x) (((VAL)(x))->info.f)
 #define GETCDATA(x) (((VAL)(x))->info.c_heap_item)
 
-#define GETBITS8(x) (((VAL)(x))->info.bits8)
-#define GETBITS16(x) (((VAL)(x))->info.bits16)
-#define GETBITS32(x) (((VAL)(x))->info.bits32)
-#define GETBITS64(x) (((VAL)(x))->info.bits64)
-
-#define TAG(x) (ISINT(x) || x == NULL ? (-1) : ( GETTY(x) == CT_CON ? (x)->info.c.tag_arity >> 8 : (-1)) )
-#define ARITY(x) (ISINT(x) || x == NULL ? (-1) : ( GETTY(x) == CT_CON ? (x)->info.c.tag_arity & 0x000000ff : (-1)) )
+#define TAG(x) (ISIMM(x) || x == NULL ? (-1) : ( GETTY(x) == CT_CON ? CTAG(x) : (-1)) )
+#define ARITY(x) (ISIMM(x) || x == NULL ? (-1) : ( GETTY(x) == CT_CON ? CARITY(x) : (-1)) )
 
 // Already checked it's a CT_CON
-#define CTAG(x) (((x)->info.c.tag_arity) >> 8)
-#define CARITY(x) ((x)->info.c.tag_arity & 0x000000ff)
+#define CTAG(x) ((uint32_t)((x)->hdr >> 32))
+#define CARITY(x) ((int)(((x)->hdr >> 24) & 0xff))
+#define CARGS(x) ((VAL*)&((x)->info))
+
+#define GETTY(x) ((x)->hdr & 0xff)
+#define SETTY(x,t) (x)->hdr = (((x)->hdr & ~(uint64_t)0xff) | (t))
+
+// Number of minor collections survived by a young object
+#define GETAGE(x) (((x)->hdr >> 8) & 0xff)
+#define SETAGE(x,a) (x)->hdr = (((x)->hdr & ~(uint64_t)0xff00) | ((a) << 8))
+
+// Set on old objects which are in the remembered set
+#define REMEMBERED 0x10000
+
+// Set on closures in the large object space
+#define LARGE 0x20000
 
-// Use top 16 bits for saying which heap value is in
-// Bottom 16 bits for closure type
+// Set while a closure is being copied by a parallel collection
+#define COPYING 0x40000
 
-#define GETTY(x) ((x)->ty & 0x0000ffff)
-#define SETTY(x,t) (x)->ty = (((x)->ty & 0xffff0000) | (t))
+// Set on closures which are outside any heap and live for the whole run:
+// the nullary constructors, and literals (see STATIC_STR)
+#define IMMORTAL 0x80000
 
-#define GETHEAP(x) ((x)->ty >> 16)
-#define SETHEAP(x,y) (x)->ty = (((x)->ty & 0x0000ffff) | ((y) << 16))
+// The garbage collector's part of the header
+#define HDR_GC_MASK ((uint64_t)0xffff00)
+
+#define CON_HDR(t, a) (((uint64_t)(t) << 32) | ((uint64_t)(a) << 24) | CT_CON)
+#define PAYLOAD_HDR(size) ((uint64_t)(size) << 24)
+#define GETPAYLOAD(x) ((size_t)((x)->hdr >> 24))
+
+// Closures are padded to 8 bytes, and always have room for a forwarding
+// pointer
+#define ALIGN_CLOSURE(size) (((size) + 7) & ~(size_t)7)
+#define CON_SIZE(a) \
+  ALIGN_CLOSURE(sizeof(uint64_t) + sizeof(VAL)*(a) < sizeof(Closure) ? \
+                sizeof(Closure) : sizeof(uint64_t) + sizeof(VAL)*(a))
+#define CLOSURE_SIZE(x) \
+  (GETTY(x) == CT_CON ? CON_SIZE(CARITY(x)) : \
+                        ALIGN_CLOSURE(sizeof(Closure) + GETPAYLOAD(x)))
 
 // Integers, floats and operators
 
@@ -214,6 +292,51 @@ typedef intptr_t i_int;
 #define ISINT(x) ((((i_int)x)&1) == 1)
 #define ISSTR(x) (GETTY(x) == CT_STRING)
 
+// Where pointers are 64 bits, more values are immediates, with a three
+// bit tag which neither an Int (xx1) nor a pointer to a closure (which
+// is 8-aligned) has. Elsewhere they're boxed.
+//  010: Bits8, Bits16 or Bits32. The next two bits are the width, and
+//       the value is above them.
+//  100: Double, if it's a zero or its exponent is within 2^-127..2^128
+//       (see MKFLOAT). Others, infinities and NaNs included, are boxed.
+#if UINTPTR_MAX > 0xffffffffu
+#define IMMEDIATE_BITS
+#define IMMEDIATE_FLOAT
+#define BITS_TAG 2
+#define FLOAT_TAG 4
+#define BITS8_WIDTH 0
+#define BITS16_WIDTH 1
+#define BITS32_WIDTH 2
+#define MKBITS(x, w) ((VAL)(((uintptr_t)(x) << 5) | ((w) << 3) | BITS_TAG))
+#define BITSTY(x) (CT_BITS8 + ((((i_int)x) >> 3) & 3))
+#define ISBITS(x) ((((i_int)x)&7) == BITS_TAG)
+#define ISFLOAT(x) ((((i_int)x)&7) == FLOAT_TAG)
+#endif
+
+// Not a pointer to a closure
+#ifdef IMMEDIATE_BITS
+#define ISIMM(x) ((((i_int)x)&7) != 0)
+#else
+#define ISIMM(x) ISINT(x)
+#endif
+
+#ifdef IMMEDIATE_BITS
+#define GETBITS8(x) ((uint8_t)((uintptr_t)(x) >> 5))
+#define GETBITS16(x) ((uint16_t)((uintptr_t)(x) >> 5))
+#define GETBITS32(x) ((uint32_t)((uintptr_t)(x) >> 5))
+#else
+#define GETBITS8(x) (((VAL)(x))->info.bits8)
+#define GETBITS16(x) (((VAL)(x))->info.bits16)
+#define GETBITS32(x) (((VAL)(x))->info.bits32)
+#endif
+#define GETBITS64(x) (((VAL)(x))->info.bits64)
+
+#ifdef IMMEDIATE_FLOAT
+#define GETFLOAT(x) idris_getFloat((VAL)(x))
+#else
+#define GETFLOAT(x) (((VAL)(x))->info.f)
+#endif
+
 #define INTOP(op,x,y) MKINT((i_int)((((i_int)x)>>1) op (((i_int)y)>>1)))
 #define UINTOP(op,x,y) MKINT((i_int)((((uintptr_t)x)>>1) op (((uintptr_t)y)>>1)))
 #define FLOATOP(op,x,y) MKFLOAT(vm, ((GETFLOAT(x)) op (GETFLOAT(y))))
@@ -223,28 +346,85 @@ typedef intptr_t i_int;
 
 // Stack management
 
-#define INITFRAME VAL* myoldbase
+#define INITFRAME VAL* myoldbase; PROF_ENTER(vm)
 #define REBASE vm->valstack_base = oldbase
-#define RESERVE(x) if (vm->valstack_top+(x) > vm->stack_max) { stackOverflow(); } \
-                   else { memset(vm->valstack_top, 0, (x)*sizeof(VAL)); }
+#define RESERVE(x) do { \
+        if (vm->valstack_top+(x) > vm->stack_max) { idris_growStack(vm, x); } \
+        memset(vm->valstack_top, 0, (x)*sizeof(VAL)); \
+    } while (0)
 #define ADDTOP(x) vm->valstack_top += (x)
 #define TOPBASE(x) vm->valstack_top = vm->valstack_base + (x)
 #define BASETOP(x) vm->valstack_base = vm->valstack_top + (x)
 #define STOREOLD myoldbase = vm->valstack_base
-#define CALL(f) f(vm, myoldbase);
+#define CALL(f) do { f(vm, myoldbase); PROF_ENTER(vm); } while (0)
 #define TAILCALL(f) f(vm, oldbase);
 
 // Creating new values (each value placed at the top of the stack)
+#ifdef IMMEDIATE_FLOAT
+VAL idris_boxFloat(VM* vm, double val);
+
+// An immediate Double is its bits rotated left by one, so that the sign
+// is the lowest bit and the exponent the highest eleven, less 896 in the
+// exponent, so that the highest three bits are zero for 256 exponents.
+// Zeros are 0 and 1, which no other Double is then.
+#define FLOAT_EXP_OFFSET ((uint64_t)896 << 53)
+
+static inline VAL MKFLOAT(VM* vm, double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    uint64_t rot = (bits << 1) | (bits >> 63);
+    if (rot > 1) {
+        rot -= FLOAT_EXP_OFFSET;
+        if (rot <= 1 || rot >= (uint64_t)1 << 61) {
+            return idris_boxFloat(vm, val);
+        }
+    }
+    return (VAL)((rot << 3) | FLOAT_TAG);
+}
+
+static inline double idris_getFloat(VAL x) {
+    if (!ISFLOAT(x)) {
+        return x->info.f;
+    }
+    uint64_t rot = (uintptr_t)x >> 3;
+    if (rot > 1) {
+        rot += FLOAT_EXP_OFFSET;
+    }
+    uint64_t bits = (rot >> 1) | (rot << 63);
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+#else
 VAL MKFLOAT(VM* vm, double val);
+#endif
 VAL MKSTR(VM* vm, const char* str);
+// A string of the first 'len' bytes of 'str'
+VAL MKSTRlen(VM* vm, const char* str, size_t len);
 VAL MKPTR(VM* vm, void* ptr);
 VAL MKMPTR(VM* vm, void* ptr, size_t size);
+#ifdef IMMEDIATE_BITS
+#define MKB8(vm, b) MKBITS((uint8_t)(b), BITS8_WIDTH)
+#define MKB16(vm, b) MKBITS((uint16_t)(b), BITS16_WIDTH)
+#define MKB32(vm, b) MKBITS((uint32_t)(b), BITS32_WIDTH)
+#else
 VAL MKB8(VM* vm, uint8_t b);
 VAL MKB16(VM* vm, uint16_t b);
 VAL MKB32(VM* vm, uint32_t b);
+#endif
 VAL MKB64(VM* vm, uint64_t b);
 VAL MKCDATA(VM* vm, CHeapItem * item);
 
+// Initialisers for literals, which the code generator makes static
+// Closures, so evaluating one doesn't allocate. Being IMMORTAL, they are
+// never collected, and are shared by every VM. A string literal is a
+// StaticString, 'n' code points long.
+#define STATIC_STR(s, n) { \
+        .closure = { .hdr = CT_STRING | IMMORTAL, .info = { .str = (s) } }, \
+        .info = { .len = sizeof(s) - 1, .chars = (n) } }
+#define STATIC_FLOAT(d) { .hdr = CT_FLOAT | IMMORTAL, .info = { .f = (d) } }
+#define STATIC_B64(b) { .hdr = CT_BITS64 | IMMORTAL, .info = { .bits64 = (b) } }
+
 // following versions don't take a lock when allocating
 VAL MKFLOATc(VM* vm, double val);
 VAL MKSTROFFc(VM* vm, StrOffset* off);
@@ -254,18 +434,47 @@ VAL MKMPTRc(VM* vm, void* ptr, size_t size);
 VAL MKCDATAc(VM* vm, CHeapItem * item);
 
 char* GETSTROFF(VAL stroff);
-
-// #define SETTAG(x, a) (x)->info.c.tag = (a)
-#define SETARG(x, i, a) ((x)->info.c.args)[i] = ((VAL)(a))
-#define GETARG(x, i) ((x)->info.c.args)[i]
+size_t GETSTROFFLEN(VAL stroff);
+// The slow paths of GETSTR, GETSTRBYTES and GETSTRLEN, for CT_STROFFSET
+// and CT_STRCONCAT
+char* idris_getStr(VAL str);
+char* idris_getStrBytes(VAL str);
+size_t idris_getStrLen(VAL str);
+
+// Allocates a string 'len' bytes long, and its NUL, for the caller to
+// fill in.
+VAL idris_allocStr(VM* vm, size_t len, int outerlock);
+// Length in code points, counted the first time it is needed.
+size_t idris_strChars(VAL str);
+
+// Non-zero while any VM is collecting incrementally. Closures may then
+// refer to ones which haven't been copied yet, so any reference read out
+// of a closure has to go through idris_readBarrier.
+extern int idris_barrier;
+VAL idris_readBarrier(VAL* field);
+void idris_readBarrierArgs(VAL x, int num);
+
+#define READ_BARRIER(field) \
+    (idris_barrier ? idris_readBarrier(&(field)) : (field))
+
+#define SETARG(x, i, a) CARGS(x)[i] = ((VAL)(a))
+#define GETARG(x, i) READ_BARRIER(CARGS(x)[i])
 
 #define PROJECT(vm,r,loc,num) \
-    memcpy(&(LOC(loc)), &((r)->info.c.args), sizeof(VAL)*num)
+  do { \
+    if (idris_barrier) idris_readBarrierArgs(r, num); \
+    memcpy(&(LOC(loc)), CARGS(r), sizeof(VAL)*num); \
+  } while (0)
 #define SLIDE(vm, args) \
     memcpy(&(LOC(0)), &(TOP(0)), sizeof(VAL)*args)
 
 void* allocate(size_t size, int outerlock);
-// void* allocCon(VM* vm, int arity, int outerlock);
+// For closures which hold no references to other closures. Large ones
+// go in the large object space, so they are never moved.
+void* allocate_data(size_t size, int outerlock);
+// Out of line part of ALLOC_CON. If 'safe', nothing but the VM's roots
+// refers to the heap, so the collector may compact.
+VAL allocConSlow(VM* vm, uint32_t tag, int arity, int outerlock, int safe);
 
 // When allocating from C, call 'idris_requireAlloc' with a size to
 // guarantee that no garbage collection will happen (and hence nothing
@@ -283,15 +492,63 @@ void* idris_alloc(size_t size);
 void* idris_realloc(void* old, size_t old_size, size_t size);
 void idris_free(void* ptr, size_t size);
 
+#ifdef HAS_PTHREAD
+#define ALLOC_INLINE(vm) ((vm)->processes == 0)
+#else
+#define ALLOC_INLINE(vm) 1
+#endif
+
+// Allocation is bumping the nursery pointer unless the nursery is full
+// or other threads may be allocating, in which case allocConSlow takes
+// care of it. Unlike allocate, the arguments are left uninitialised, so
+// they must all be set before anything else is allocated.
+#define ALLOC_CON(cl, vm, t, a, o, safe) \
+  do { \
+    if (ALLOC_INLINE(vm) && \
+        (vm)->heap.next + CON_SIZE(a) < (vm)->heap.limit) { \
+        cl = (VAL)((vm)->heap.next); \
+        (vm)->heap.next += CON_SIZE(a); \
+        STATS_ALLOC((vm)->stats, CON_SIZE(a)) \
+        cl->hdr = CON_HDR(t, a); \
+        PROF_ALLOC(vm, cl, CON_SIZE(a)); \
+    } else { \
+        cl = allocConSlow(vm, t, a, o, safe); \
+    } \
+  } while (0)
+
+// For code generated by CodegenC only, which sets every argument before
+// it allocates anything else, and keeps everything in the VM's roots.
+#define GEN_ALLOC_CON(cl, vm, t, a) ALLOC_CON(cl, vm, t, a, 0, 1)
+
+// The old closure always has the same arity, so its size doesn't change.
+#define GEN_UPDATE_CON(cl, vm, old, t, a) \
+  do { \
+    cl = old; \
+    cl->hdr = (cl->hdr & HDR_GC_MASK) | CON_HDR(t, a); \
+    WRITE_BARRIER(vm, cl); \
+  } while (0)
+
+// For C code. The arguments start out NULL, since it may allocate (and
+// so collect) before it has set them all.
 #define allocCon(cl, vm, t, a, o) \
-  cl = allocate(sizeof(Closure) + sizeof(VAL)*a, o); \
-  SETTY(cl, CT_CON); \
-  cl->info.c.tag_arity = ((t) << 8) | (a);
+  do { \
+    ALLOC_CON(cl, vm, t, a, o, 0); \
+    memset(CARGS(cl), 0, sizeof(VAL) * (a)); \
+  } while (0)
+
+#define updateCon(cl, old, t, a) GEN_UPDATE_CON(cl, get_vm(), old, t, a)
+
+#define ISOLD(vm, x) ((char*)(x) >= (vm)->gen.old.heap && \
+                      (char*)(x) < (vm)->gen.old.end)
 
-#define updateCon(cl, old, t, a) \
-  cl = old; \
-  SETTY(cl, CT_CON); \
-  cl->info.c.tag_arity = ((t) << 8) | (a);
+// Must be used when a closure is updated in place, since the update may
+// make an object in the old generation point to a young one.
+#define WRITE_BARRIER(vm, x) \
+  do { \
+    if (ISOLD(vm, x) && !((x)->hdr & REMEMBERED)) { \
+        remset_add(&(vm)->gen.remembered, x); \
+    } \
+  } while (0)
 
 #define NULL_CON(x) nullary_cons[x]
 
@@ -359,14 +616,33 @@ VAL idris_pokeSingle(VAL ptr, VAL offset, VAL data);
 VAL idris_concat(VM* vm, VAL l, VAL r);
 VAL idris_strlt(VM* vm, VAL l, VAL r);
 VAL idris_streq(VM* vm, VAL l, VAL r);
+// The FNV-1a hash of a string's bytes, which CodegenC also computes for
+// the literals in a case on strings
+uint32_t idris_strHash(VAL str);
 VAL idris_strlen(VM* vm, VAL l);
 VAL idris_readStr(VM* vm, FILE* h);
+// Reads up to n lines, each with its newline, as one string
+VAL idris_readLines(VM* vm, void* h, int n);
+// Writes a string without flattening it. Returns 0, or -1 on error.
+int idris_writeStrVal(void* h, VAL str);
 
 VAL idris_strHead(VM* vm, VAL str);
 VAL idris_strTail(VM* vm, VAL str);
 // This is not expected to be efficient! Mostly we wouldn't expect to call
 // it at all at run time.
 VAL idris_strCons(VM* vm, VAL x, VAL xs);
+
+// String builders, for building a string up by appending to it in place
+// (see Data.String.Builder). None of these collect.
+VAL idris_builderNew(VM* vm, int capacity);
+void idris_builderAppendStr(VM* vm, VAL b, VAL str);
+void idris_builderAppendChar(VM* vm, VAL b, VAL c);
+void idris_builderAppendInt(VM* vm, VAL b, VAL i);
+void idris_builderAppendFloat(VM* vm, VAL b, VAL f);
+// Length in bytes so far
+int idris_builderLength(VAL b);
+// The string built so far. The builder can still be appended to after.
+VAL idris_builderFreeze(VM* vm, VAL b);
 VAL idris_strIndex(VM* vm, VAL str, VAL i);
 VAL idris_strRev(VM* vm, VAL str);
 VAL idris_substr(VM* vm, VAL offset, VAL length, VAL str);
@@ -390,6 +666,12 @@ const char *idris_getArg(int i);
 
 void stackOverflow();
 
+// Commit enough of the stack for 'x' more values, or fail with a stack
+// overflow if that would take it past its limit (see RESERVE).
+void idris_growStack(VM* vm, size_t x);
+// Decommit the stack well beyond what is in use, after a major collection.
+void idris_shrinkStack(VM* vm);
+
 // I think these names are nicer for an API...
 
 #define idris_constructor allocCon
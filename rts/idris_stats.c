@@ -35,7 +35,9 @@ void print_stats(const Stats * stats) {
     printf("%'20" PRIu32 " chunks allocated in the heap\n", stats->alloc_count);
     printf("%'20" PRIu64 " average chunk size\n\n",         avg_chunk);
 
-    printf("GC called %d times\n\n", stats->collections);
+    printf("GC called %d times (%d minor, %d compacting)\n\n",
+           stats->collections, stats->minor_collections,
+           stats->compactions);
 
     printf("INIT  time: %8.3fs\n",   (double)stats->init_time / CLOCKS_PER_SEC);
     printf("MUT   time: %8.3fs\n",   mut_sec);
@@ -24,6 +24,8 @@ typedef struct {
     clock_t start_time;    // Time of rts entry point.
 #endif // IDRIS_ENABLE_STATS
     uint32_t collections;       // How many times gc called.
+    uint32_t minor_collections; // How many of those only collected the nursery.
+    uint32_t compactions;       // How many of those compacted rather than copied.
 } Stats; // without start time it's a monoid, can we remove start_time it somehow?
 
 void print_stats(const Stats * stats);
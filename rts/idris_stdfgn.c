@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
 
 #if defined(WIN32) || defined(__WIN32) || defined(__WIN32__)
 int win_fpoll(void* h);
@@ -17,7 +18,7 @@ int win_fpoll(void* h);
 extern char** environ;
 
 void putStr(char* str) {
-    printf("%s", str);
+    fputs(str, stdout);
 }
 
 void* fileOpen(char* name, char* mode) {
@@ -25,9 +26,16 @@ void* fileOpen(char* name, char* mode) {
     return (void*)f;
 }
 
+static char* take_buffer(FILE* f);
+
 void fileClose(void* h) {
     FILE* f = (FILE*)h;
+    // Forget the buffer before f is closed, when another handle may be
+    // opened at the same address, but free it only once fclose is done
+    // writing from it.
+    char* buf = take_buffer(f);
     fclose(f);
+    free(buf);
 }
 
 int fileEOF(void* h) {
@@ -49,6 +57,88 @@ int idris_writeStr(void* h, char* str) {
     }
 }
 
+/* *** Output buffering ***
+ * Buffers of a given size belong to the RTS rather than stdio, so are
+ * kept with their handles until they are closed.
+ */
+
+typedef struct OutBuffer {
+    FILE* file;
+    char* buf;
+    struct OutBuffer* next;
+} OutBuffer;
+
+static OutBuffer* out_buffers = NULL;
+
+#ifdef HAS_PTHREAD
+static pthread_mutex_t out_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+#define OUT_BUFFERS_LOCK pthread_mutex_lock(&out_buffers_lock);
+#define OUT_BUFFERS_UNLOCK pthread_mutex_unlock(&out_buffers_lock);
+#else
+#define OUT_BUFFERS_LOCK
+#define OUT_BUFFERS_UNLOCK
+#endif
+
+// Forget f's buffer, returning it for the caller to free
+static char* take_buffer(FILE* f) {
+    char* buf = NULL;
+    OutBuffer** b;
+    OUT_BUFFERS_LOCK
+    for (b = &out_buffers; *b != NULL; b = &(*b)->next) {
+        if ((*b)->file == f) {
+            OutBuffer* found = *b;
+            *b = found->next;
+            buf = found->buf;
+            free(found);
+            break;
+        }
+    }
+    OUT_BUFFERS_UNLOCK
+    return buf;
+}
+
+int idris_setBuffering(void* h, int mode, int size) {
+    FILE* f = (FILE*)h;
+    int how;
+    switch (mode) {
+    case BUF_NONE: how = _IONBF; break;
+    case BUF_LINE: how = _IOLBF; break;
+    case BUF_BLOCK: how = _IOFBF; break;
+    default: how = isatty(fileno(f)) ? _IOLBF : _IOFBF; break;
+    }
+
+    char* buf = NULL;
+    if (how != _IONBF && size > 0) {
+        buf = malloc(size);
+        if (buf == NULL) {
+            return -1;
+        }
+    }
+
+    fflush(f);
+    if (setvbuf(f, buf, how, size > 0 ? (size_t)size : BUFSIZ) != 0) {
+        free(buf);
+        return -1;
+    }
+    // Only now that stdio has stopped using it
+    char* old = take_buffer(f);
+    if (buf != NULL) {
+        OutBuffer* b = malloc(sizeof(OutBuffer));
+        if (b == NULL) {
+            fprintf(stderr, "RTS ERROR: Unable to allocate output buffer.\n");
+            exit(EXIT_FAILURE);
+        }
+        b->file = f;
+        b->buf = buf;
+        OUT_BUFFERS_LOCK
+        b->next = out_buffers;
+        out_buffers = b;
+        OUT_BUFFERS_UNLOCK
+    }
+    free(old);
+    return 0;
+}
+
 int fpoll(void* h)
 {
 #if defined(WIN32) || defined(__WIN32) || defined(__WIN32__)
@@ -117,5 +207,5 @@ VAL idris_mkFileError(VM* vm) {
 }
 
 void idris_forceGC(void* vm) {
-    idris_gc((VM*)vm);
+    idris_safeGC((VM*)vm, 1);
 }
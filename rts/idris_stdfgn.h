@@ -14,6 +14,16 @@ int fileEOF(void* h);
 int fileError(void* h);
 // return 0 on success
 int idris_writeStr(void*h, char* str);
+
+// How a handle's output is buffered (as BufferMode in Prelude.File)
+#define BUF_NONE  0
+#define BUF_LINE  1
+#define BUF_BLOCK 2
+#define BUF_AUTO  3 // Line buffered on a terminal, block buffered otherwise
+
+// Buffer h's output, in a buffer of 'size' bytes (or the C library's
+// default size, if 0). Return 0 on success.
+int idris_setBuffering(void* h, int mode, int size);
 // construct a file error structure (see Prelude.File) from errno
 VAL idris_mkFileError(VM* vm);
 
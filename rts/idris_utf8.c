@@ -3,13 +3,228 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UTF8_SIMD
+#include <immintrin.h>
+#endif
+
+/* *** Kernels ***
+ * Counting characters is counting the bytes which aren't continuation
+ * bytes (10xxxxxx), which as signed chars are those less than -64. With
+ * vectors, a block of bytes is compared at once, and the matches either
+ * summed (in a byte per lane, for up to 255 blocks before they would
+ * overflow) or, to find a particular one, turned into a bit mask.
+ */
+
+typedef struct {
+    size_t (*count)(const char* s, size_t len);
+    size_t (*ascii)(const char* s, size_t len);
+    const char* (*skip)(const char* s, size_t len, size_t n);
+} Utf8Kernels;
+
+static size_t count_scalar(const char* s, size_t len) {
+    size_t chars = 0;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        chars += (s[i] & 0xc0) != 0x80;
+    }
+    return chars;
+}
+
+static size_t ascii_scalar(const char* s, size_t len) {
+    size_t i = 0;
+    while (i < len && (s[i] & 0x80) == 0) {
+        ++i;
+    }
+    return i;
+}
+
+static const char* skip_scalar(const char* s, size_t len, size_t n) {
+    const char* end = s + len;
+    while (n > 0 && s < end) {
+        if ((*s & 0xc0) != 0x80) {
+            n--;
+        }
+        s++;
+    }
+    // Now we've found the first byte of the last character. Advance
+    // to the end of it.
+    while (s < end && (*s & 0xc0) == 0x80) {
+        s++;
+    }
+    return s;
+}
+
+static const Utf8Kernels scalar_kernels = {
+    count_scalar, ascii_scalar, skip_scalar
+};
+
+#ifdef UTF8_SIMD
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2,popcnt")))
+
+SSE2 static size_t count_sse2(const char* s, size_t len) {
+    const __m128i limit = _mm_set1_epi8(-64);
+    size_t i = 0;
+    size_t cont = 0;
+    int n;
+
+    while (len - i >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (n = 0; n < 255 && len - i >= 16; ++n, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            acc = _mm_sub_epi8(acc, _mm_cmplt_epi8(v, limit));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        cont += _mm_extract_epi16(sums, 0) + _mm_extract_epi16(sums, 4);
+    }
+    return i - cont + count_scalar(s + i, len - i);
+}
+
+SSE2 static size_t ascii_sse2(const char* s, size_t len) {
+    size_t i = 0;
+    for (; len - i >= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        unsigned high = _mm_movemask_epi8(v);
+        if (high != 0) {
+            return i + __builtin_ctz(high);
+        }
+    }
+    return i + ascii_scalar(s + i, len - i);
+}
+
+SSE2 static const char* skip_sse2(const char* s, size_t len, size_t n) {
+    const __m128i limit = _mm_set1_epi8(-64);
+    const char* end = s + len;
+
+    // Skip whole blocks with no more than n characters starting in them.
+    while (end - s >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)s);
+        unsigned cont = _mm_movemask_epi8(_mm_cmplt_epi8(v, limit));
+        size_t starts = 16 - __builtin_popcount(cont);
+        if (starts > n) {
+            break;
+        }
+        n -= starts;
+        s += 16;
+    }
+    return skip_scalar(s, end - s, n);
+}
+
+static const Utf8Kernels sse2_kernels = {
+    count_sse2, ascii_sse2, skip_sse2
+};
+
+AVX2 static size_t count_avx2(const char* s, size_t len) {
+    const __m256i limit = _mm256_set1_epi8(-64);
+    size_t i = 0;
+    size_t cont = 0;
+    int n;
+
+    while (len - i >= 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (n = 0; n < 255 && len - i >= 32; ++n, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(limit, v));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                     _mm256_extracti128_si256(sums, 1));
+        cont += _mm_extract_epi16(half, 0) + _mm_extract_epi16(half, 4);
+    }
+    return i - cont + count_scalar(s + i, len - i);
+}
+
+AVX2 static size_t ascii_avx2(const char* s, size_t len) {
+    size_t i = 0;
+    for (; len - i >= 32; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        unsigned high = _mm256_movemask_epi8(v);
+        if (high != 0) {
+            return i + __builtin_ctz(high);
+        }
+    }
+    return i + ascii_scalar(s + i, len - i);
+}
+
+AVX2 static const char* skip_avx2(const char* s, size_t len, size_t n) {
+    const __m256i limit = _mm256_set1_epi8(-64);
+    const char* end = s + len;
+
+    while (end - s >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)s);
+        unsigned cont = _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, v));
+        size_t starts = 32 - __builtin_popcount(cont);
+        if (starts > n) {
+            break;
+        }
+        n -= starts;
+        s += 32;
+    }
+    return skip_scalar(s, end - s, n);
+}
+
+static const Utf8Kernels avx2_kernels = {
+    count_avx2, ascii_avx2, skip_avx2
+};
+
+#endif // UTF8_SIMD
+
+static const Utf8Kernels* kernels = NULL;
+static int kernels_used = UTF8_SCALAR;
+
+int idris_utf8_select(int wanted) {
+    int best = UTF8_SCALAR;
+#ifdef UTF8_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        best = UTF8_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        best = UTF8_SSE2;
+    }
+#endif
+    kernels_used = wanted == UTF8_AUTO || wanted > best ? best : wanted;
+
+    switch (kernels_used) {
+#ifdef UTF8_SIMD
+    case UTF8_AVX2:
+        kernels = &avx2_kernels;
+        break;
+    case UTF8_SSE2:
+        kernels = &sse2_kernels;
+        break;
+#endif
+    default:
+        kernels = &scalar_kernels;
+        break;
+    }
+    return kernels_used;
+}
+
+static const Utf8Kernels* get_kernels(void) {
+    if (kernels == NULL) {
+        idris_utf8_select(UTF8_AUTO);
+    }
+    return kernels;
+}
+
+size_t idris_utf8_count(const char* s, size_t len) {
+    return get_kernels()->count(s, len);
+}
+
+size_t idris_utf8_ascii(const char* s, size_t len) {
+    return get_kernels()->ascii(s, len);
+}
+
+const char* idris_utf8_skip(const char* s, size_t len, size_t n) {
+    return get_kernels()->skip(s, len, n);
+}
+
+/* *** Strings *** */
+
 int idris_utf8_strlen(char *s) {
-   int i = 0, j = 0;
-   while (s[i]) {
-     if ((s[i] & 0xc0) != 0x80) j++;
-     i++;
-   }
-   return j;
+    return (int)idris_utf8_count(s, strlen(s));
 }
 
 int idris_utf8_charlen(char* s) {
@@ -30,28 +245,25 @@ int idris_utf8_charlen(char* s) {
 }
 
 unsigned idris_utf8_index(char* s, int idx) {
-   int i = 0, j = 0;
-   while (j < idx) {
-     if ((s[i] & 0xc0) != 0x80) j++;
-     i++;
-   }
-   // Find the start of the next character
-   while ((s[i] & 0xc0) == 0x80) { i++; }
+    return idris_utf8_decode(idris_utf8_skip(s, strlen(s), idx > 0 ? idx : 0));
+}
 
+unsigned idris_utf8_decode(const char* s) {
    unsigned bytes = 0;
    unsigned top = 0;
+   int i = 0;
 
-   int init = (int)s[1];
+   unsigned char init = (unsigned char)s[0];
 
-   // s[i] is now the start of the character we want
+   // s[0] is the start of the character we want
    if ((s[i] & 0x80) == 0) {
        bytes = 1;
        top = (int)(s[i]);
-   } else if ((init > 244 && init < 256) ||
+   } else if ((init > 244) ||
               (init == 192) ||
               (init == 193)) {
        bytes = 1;
-       top = (int)(s[i]); // Invalid characters
+       top = init; // Invalid characters
    } else if ((s[i] & 0xe0) == 0xc0) {
        bytes = 2;
        top = (int)(s[i] & 0x1f); // 5 bits
@@ -79,40 +291,19 @@ unsigned idris_utf8_index(char* s, int idx) {
 }
 
 char* idris_utf8_advance(char* str, int i) {
-    while (i > 0 && *str != '\0') {
-        // In a UTF8 single-byte char, the highest bit is 0.  In the
-        // first byte of a multi-byte char, the highest two bits are
-        // 11, but the rest of the bytes start with 10. So we can
-        // decrement our character counter when we see something other
-        // than 10 at the front.
-
-        // This is a bit of an overapproximation, as invalid multibyte
-        // sequences that are too long will be treated as if they are
-        // OK, but it's always paying attention to null-termination.
-        if ((*str & 0xc0) != 0x80) {
-            i--;
-        }
-        str++;
-    }
-    // Now we've found the first byte of the last character. Advance
-    // to the end of it, or the end of the string, whichever is first.
-    // Here, we don't risk overrunning the end of the string because
-    // ('\0' & 0xc0) != 0x80.
-    while ((*str & 0xc0) == 0x80) { str++; }
-
-    return str;
+    // This is a bit of an overapproximation, as invalid multibyte
+    // sequences that are too long will be treated as if they are
+    // OK, but it never goes past the terminator.
+    return (char*)idris_utf8_skip(str, strlen(str), i > 0 ? i : 0);
 }
 
 
-char* idris_utf8_fromChar(int x) {
-    char* str;
+int idris_utf8_encode(int x, char* buf) {
     int bytes = 0, top = 0;
 
     if ((x & 0x80) == 0) {
-        str = malloc(2);
-        str[0] = (char)x;
-        str[1] = '\0';
-        return str;
+        buf[0] = (char)x;
+        return 1;
     }
 
     if (x >= 0x80 && x <= 0x7ff) {
@@ -126,19 +317,24 @@ char* idris_utf8_fromChar(int x) {
         top = 0xf0;
     }
 
-    str = malloc(bytes + 1);
-    str[bytes] = '\0';
+    int len = bytes;
     while(bytes > 0) {
         int xbits = x & 0x3f; // Next 6 bits
         bytes--;
         if (bytes > 0) {
-            str[bytes] = (char)xbits + 0x80;
+            buf[bytes] = (char)xbits + 0x80;
         } else {
-            str[0] = (char)xbits + top;
+            buf[0] = (char)xbits + top;
         }
         x = x >> 6;
     }
 
+    return len;
+}
+
+char* idris_utf8_fromChar(int x) {
+    char* str = malloc(5);
+    str[idris_utf8_encode(x, str)] = '\0';
     return str;
 }
 
@@ -160,10 +356,21 @@ char* reverse_char(char *start)
     return(end + 1);
 }
 
-char* idris_utf8_rev(char* s, char* result) {
-    strcpy(result, s);
+char* idris_utf8_rev(const char* s, size_t len, char* result) {
+    size_t i;
+    if (idris_utf8_ascii(s, len) == len) {
+        // Every character is a byte
+        for (i = 0; i < len; ++i) {
+            result[i] = s[len - 1 - i];
+        }
+        result[len] = '\0';
+        return result;
+    }
+
+    memcpy(result, s, len);
+    result[len] = '\0';
     char* end = result;
-    while(*end) { end = reverse_char(end); }
+    while(end < result + len) { end = reverse_char(end); }
     reverse_range(result, end-1);
     return result;
 }
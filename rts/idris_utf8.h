@@ -6,6 +6,8 @@
    correctness.) Nevertheless, they mean that we can treat Strings as
    UFT8. Patches welcome :). */
 
+#include <stddef.h>
+
 // Get length of a UTF8 encoded string in characters
 int idris_utf8_strlen(char *s);
 // Get number of bytes the first character takes in a string
@@ -16,9 +18,36 @@ unsigned idris_utf8_index(char* s, int j);
 // Convert a char as an integer to a char* as a byte sequence
 // Null terminated; caller responsible for freeing
 char* idris_utf8_fromChar(int x);
-// Reverse a UTF8 encoded string, putting the result in 'result'
-char* idris_utf8_rev(char* s, char* result);
+// The same, written to buf, which has room for 4 bytes. Returns how many
+// were written (none if x isn't a code point), with no terminator.
+int idris_utf8_encode(int x, char* buf);
+// Reverse a UTF8 encoded string of len bytes, which may contain NULs,
+// putting the result in 'result', with a NUL after it
+char* idris_utf8_rev(const char* s, size_t len, char* result);
 // Advance a pointer into a string by i UTF8 characters.
 // Return original pointer if i <= 0.
 char* idris_utf8_advance(char* str, int i);
+
+// The same, but for strings whose length is known, so they needn't be
+// scanned for the terminator and can be taken in vector-sized blocks.
+
+// Number of characters in the first len bytes of s
+size_t idris_utf8_count(const char* s, size_t len);
+// Number of bytes at the start of s which are ASCII
+size_t idris_utf8_ascii(const char* s, size_t len);
+// Advance s by n characters, or to s + len if it has fewer
+const char* idris_utf8_skip(const char* s, size_t len, size_t n);
+// The character which s starts with
+unsigned idris_utf8_decode(const char* s);
+
+// The implementations of the above to use: by default the widest vectors
+// the CPU supports (see +RTS -u)
+#define UTF8_AUTO 0
+#define UTF8_SCALAR 1
+#define UTF8_SSE2 2
+#define UTF8_AVX2 3
+
+// Returns which is used, which may be narrower than asked for if the CPU
+// can't do it.
+int idris_utf8_select(int kernels);
 #endif
@@ -13,7 +13,8 @@ import Util.System
 import Numeric
 import Data.Char
 import Data.Bits
-import Data.List (intercalate, nubBy)
+import Data.List (intercalate, nubBy, groupBy, sortBy, foldl')
+import Data.Word (Word32)
 import System.Process
 import System.Exit
 import System.IO
@@ -147,42 +148,56 @@ showCStr s = '"' : foldr ((++) . showChar) "\"" s
         | ord c < 0x10  = "\"\"\\x0" ++ showHex (ord c) "\"\""
         | ord c < 0x20  = "\"\"\\x"  ++ showHex (ord c) "\"\""
         | ord c < 0x7f  = [c]    -- 0x7f = \DEL
-        | otherwise = showHexes (utf8bytes (ord c))
+        | otherwise = showHexes (utf8Bytes c)
 
-    utf8bytes :: Int -> [Int]
-    utf8bytes x = let (h : bytes) = split [] x in
-                      headHex h (length bytes) : map toHex bytes
-      where
-        split acc 0 = acc
-        split acc x = let xbits = x .&. 0x3f
-                          xrest = shiftR x 6 in
-                          split (xbits : acc) xrest
+    showHexes = foldr ((++) . showUTF8) ""
+    showUTF8 c = "\"\"\\x" ++ showHex c "\"\""
 
-        headHex h 1 = h + 0xc0
-        headHex h 2 = h + 0xe0
-        headHex h 3 = h + 0xf0
-        headHex h n = error "Can't happen: Invalid UTF8 character"
+-- The bytes showCStr writes for a character
+utf8Bytes :: Char -> [Int]
+utf8Bytes c
+    | x < 0x80    = [x]
+    | x < 0x800   = [0xc0 .|. shiftR x 6, cont 0]
+    | x < 0x10000 = [0xe0 .|. shiftR x 12, cont 6, cont 0]
+    | otherwise   = [0xf0 .|. shiftR x 18, cont 12, cont 6, cont 0]
+  where
+    x = ord c
+    cont n = 0x80 .|. (shiftR x n .&. 0x3f)
 
-        toHex i = i + 0x80
+-- The length of a string literal in bytes, and its hash, as GETSTRLEN and
+-- idris_strHash (FNV-1a) find them at run time
+strBytes :: String -> Int
+strBytes = length . concatMap utf8Bytes
 
-    showHexes = foldr ((++) . showUTF8) ""
-    showUTF8 c = "\"\"\\x" ++ showHex c "\"\""
+strHash :: String -> Word32
+strHash = foldl' step 2166136261 . concatMap utf8Bytes
+  where
+    step h b = (h `xor` fromIntegral b) * 16777619
 
 bcc :: Int -> BC -> String
 bcc i (ASSIGN l r) = indent i ++ creg l ++ " = " ++ creg r ++ ";\n"
 bcc i (ASSIGNCONST l c)
+    | Just (ty, lit) <- staticConst c
+    = indent i ++ "{ static " ++ ty ++ " lit = " ++ lit ++ "; " ++
+                  creg l ++ " = (VAL)&lit; }\n"
+    | otherwise
     = indent i ++ creg l ++ " = " ++ mkConst c ++ ";\n"
   where
+    -- Literals which would otherwise be allocated every time they're
+    -- evaluated are static closures instead (see STATIC_STR)
+    staticConst (Fl f) = Just ("Closure", "STATIC_FLOAT(" ++ show f ++ ")")
+    staticConst (Str s) = Just ("StaticString", "STATIC_STR(" ++ showCStr s ++
+                                                ", " ++ show (length s) ++ ")")
+    staticConst (B64 x) = Just ("Closure", "STATIC_B64(" ++ show x ++ "ULL)")
+    staticConst _ = Nothing
+
     mkConst (I i) = "MKINT(" ++ show i ++ ")"
     mkConst (BI i) | i < (2^30) = "MKINT(" ++ show i ++ ")"
                    | otherwise = "MKBIGC(vm,\"" ++ show i ++ "\")"
-    mkConst (Fl f) = "MKFLOAT(vm, " ++ show f ++ ")"
     mkConst (Ch c) = "MKINT(" ++ show (fromEnum c) ++ ")"
-    mkConst (Str s) = "MKSTR(vm, " ++ showCStr s ++ ")"
-    mkConst (B8  x) = "idris_b8const(vm, "  ++ show x ++ "U)"
-    mkConst (B16 x) = "idris_b16const(vm, " ++ show x ++ "U)"
-    mkConst (B32 x) = "idris_b32const(vm, " ++ show x ++ "UL)"
-    mkConst (B64 x) = "idris_b64const(vm, " ++ show x ++ "ULL)"
+    mkConst (B8  x) = mkBits IT8 (show x ++ "U")
+    mkConst (B16 x) = mkBits IT16 (show x ++ "U")
+    mkConst (B32 x) = mkBits IT32 (show x ++ "UL")
     -- if it's a type constant, we won't use it, but equally it shouldn't
     -- report an error. These might creep into generated for various reasons
     -- (especially if erasure is disabled).
@@ -204,10 +219,10 @@ bcc i (MKCON l loc tag args)
         setArgs i (x : xs) = "SETARG(" ++ creg Tmp ++ ", " ++ show i ++ ", " ++ creg x ++
                              "); " ++ setArgs (i + 1) xs
         alloc Nothing tag
-            = "allocCon(" ++ creg Tmp ++ ", vm, " ++ show tag ++ ", " ++
-                    show (length args) ++ ", 0);\n"
+            = "GEN_ALLOC_CON(" ++ creg Tmp ++ ", vm, " ++ show tag ++ ", " ++
+                    show (length args) ++ ");\n"
         alloc (Just old) tag
-            = "updateCon(" ++ creg Tmp ++ ", " ++ creg old ++ ", " ++ show tag ++ ", " ++
+            = "GEN_UPDATE_CON(" ++ creg Tmp ++ ", vm, " ++ creg old ++ ", " ++ show tag ++ ", " ++
                     show (length args) ++ ");\n"
 
 bcc i (PROJECT l loc a) = indent i ++ "PROJECT(vm, " ++ creg l ++ ", " ++ show loc ++
@@ -250,9 +265,13 @@ bcc i (CONSTCASE r code def)
 --        indent i ++ "}\n"
      = concatMap (iCase (creg r)) code ++
        indent i ++ "{\n" ++ showDefS i def ++ indent i ++ "}\n"
+   | strConsts code && length code >= 4
+     = altSwitch (strDispatch (creg r))
    | strConsts code
-     = concatMap (strCase ("GETSTR(" ++ creg r ++ ")")) code ++
+     = concatMap (strCase (creg r)) code ++
        indent i ++ "{\n" ++ showDefS i def ++ indent i ++ "}\n"
+   | bigintConsts code && length code >= 4
+     = altSwitch (bigDispatch (creg r))
    | bigintConsts code
      = concatMap (biCase (creg r)) code ++
        indent i ++ "{\n" ++ showDefS i def ++ indent i ++ "}\n"
@@ -272,11 +291,96 @@ bcc i (CONSTCASE r code def)
     strConsts ((Str _, _ ) : _) = True
     strConsts _ = False
 
-    strCase sv (s, bc) =
-        indent i ++ "if (strcmp(" ++ sv ++ ", " ++ show s ++ ") == 0) {\n" ++
+    -- A case with many alternatives finds which one matches first, by
+    -- switching on what it can (see strDispatch and bigDispatch), then
+    -- switches on that.
+    altSwitch dispatch =
+        indent i ++ "{\n" ++
+        indent (i + 1) ++ "int alt = -1;\n" ++
+        dispatch ++
+        indent (i + 1) ++ "switch(alt) {\n" ++
+        concatMap (showCase (i + 1)) (zip [0 :: Int ..] (map snd code)) ++
+        showDef (i + 1) def ++
+        indent (i + 1) ++ "}\n" ++
+        indent i ++ "}\n"
+
+    -- Each alternative's constant with its number, the first one only if
+    -- a constant is repeated
+    alts = nubBy (\x y -> fst x == fst y) (zip (map fst code) [0 :: Int ..])
+
+    groupOn f = groupBy (\x y -> f x == f y) . sortBy (\x y -> compare (f x) (f y))
+
+    -- Strings are switched on by length, then by hash if several have
+    -- that length, and only then compared.
+    strDispatch sv =
+        indent (i + 1) ++ "switch(GETSTRLEN(" ++ sv ++ ")) {\n" ++
+        concatMap lenCase (groupOn (strBytes . fst) strs) ++
+        indent (i + 1) ++ "}\n"
+      where
+        strs = [(s, n) | (Str s, n) <- alts]
+
+        lenCase ss@((s, _) : _) =
+            indent (i + 1) ++ "case " ++ show (strBytes s) ++ ":\n" ++
+            lenBody ss ++ indent (i + 2) ++ "break;\n"
+
+        lenBody [s] = strTests (i + 2) [s]
+        lenBody ss = indent (i + 2) ++ "switch(idris_strHash(" ++ sv ++ ")) {\n" ++
+                     concatMap hashCase (groupOn (strHash . fst) ss) ++
+                     indent (i + 2) ++ "}\n"
+
+        hashCase ss@((s, _) : _) =
+            indent (i + 2) ++ "case " ++ show (strHash s) ++ "u:\n" ++
+            strTests (i + 3) ss ++ indent (i + 3) ++ "break;\n"
+
+        strTests j ss = indent j ++ intercalate (indent j ++ "else ") (map strTest ss)
+        strTest (s, n) = "if (STREQLIT(" ++ sv ++ ", " ++ showCStr s ++ ")) alt = " ++
+                         show n ++ ";\n"
+
+    -- Integers which fit in 64 bits are switched on, and the rest are
+    -- compared.
+    bigDispatch bv =
+        indent (i + 1) ++ "{\n" ++
+        indent (i + 2) ++ "int64_t small;\n" ++
+        indent (i + 2) ++ "if (bigSmall(" ++ bv ++ ", &small)) {\n" ++
+        indent (i + 3) ++ "switch(small) {\n" ++
+        concatMap smallCase smalls ++
+        indent (i + 3) ++ "}\n" ++
+        indent (i + 2) ++ "} else {\n" ++
+        concatMap bigTest bigs ++
+        indent (i + 2) ++ "}\n" ++
+        indent (i + 1) ++ "}\n"
+      where
+        isSmall b = abs b < 2^63
+        smalls = [(b, n) | (BI b, n) <- alts, isSmall b]
+        bigs = [(b, n) | (BI b, n) <- alts, not (isSmall b)]
+
+        smallCase (b, n) = indent (i + 3) ++ "case " ++ int64Lit b ++ ": alt = " ++
+                           show n ++ "; break;\n"
+        bigTest (b, n) = indent (i + 3) ++ "if (alt < 0 && " ++ bigEq bv b ++
+                         ") alt = " ++ show n ++ ";\n"
+
+        int64Lit b | b < 0 = "-INT64_C(" ++ show (negate b) ++ ")"
+                   | otherwise = "INT64_C(" ++ show b ++ ")"
+
+    -- bigEqConst takes an int, so larger constants are given as 32 bit
+    -- words
+    bigEq bv b
+        | b >= -(2^31) && b < 2^31
+        = "bigEqConst(" ++ bv ++ ", " ++ show b ++ ")"
+        | otherwise
+        = "bigEqWords(" ++ bv ++ ", " ++ show (signum b) ++ ", (const uint32_t[]){" ++
+          intercalate ", " (map (\w -> show w ++ "u") ws) ++ "}, " ++
+          show (length ws) ++ ")"
+      where
+        ws = words32 (abs b)
+        words32 0 = []
+        words32 m = m `mod` 2^32 : words32 (m `div` 2^32)
+
+    strCase sv (Str s, bc) =
+        indent i ++ "if (STREQLIT(" ++ sv ++ ", " ++ showCStr s ++ ")) {\n" ++
            concatMap (bcc (i+1)) bc ++ indent i ++ "} else\n"
     biCase bv (BI b, bc) =
-        indent i ++ "if (bigEqConst(" ++ bv ++ ", " ++ show b ++ ")) {\n"
+        indent i ++ "if (" ++ bigEq bv b ++ ") {\n"
            ++ concatMap (bcc (i+1)) bc ++ indent i ++ "} else\n"
     iCase v (I b, bc) =
         indent i ++ "if (GETINT(" ++ v ++ ") == " ++ show b ++ ") {\n"
@@ -372,8 +476,7 @@ toFunType _ = FAny
 
 c_irts (FArith (ATInt ITNative)) l x = l ++ "MKINT((i_int)(" ++ x ++ "))"
 c_irts (FArith (ATInt ITChar))  l x = c_irts (FArith (ATInt ITNative)) l x
-c_irts (FArith (ATInt (ITFixed ity))) l x
-    = l ++ "idris_b" ++ show (nativeTyWidth ity) ++ "const(vm, " ++ x ++ ")"
+c_irts (FArith (ATInt (ITFixed ity))) l x = l ++ mkBits ity x
 c_irts FString l x = l ++ "MKSTR(vm, " ++ x ++ ")"
 c_irts FUnit l x = x
 c_irts FPtr l x = l ++ "MKPTR(vm, " ++ x ++ ")"
@@ -386,8 +489,7 @@ c_irts FFunctionIO l x = error "Return of function from foreign call is not supp
 
 irts_c (FArith (ATInt ITNative)) x = "GETINT(" ++ x ++ ")"
 irts_c (FArith (ATInt ITChar)) x = irts_c (FArith (ATInt ITNative)) x
-irts_c (FArith (ATInt (ITFixed ity))) x
-    = "(" ++ x ++ "->info.bits" ++ show (nativeTyWidth ity) ++ ")"
+irts_c (FArith (ATInt (ITFixed ity))) x = getBits ity x
 irts_c FString x = "GETSTR(" ++ x ++ ")"
 irts_c FUnit x = x
 irts_c FPtr x = "GETPTR(" ++ x ++ ")"
@@ -404,7 +506,44 @@ cFnSig name rty args = ctype rty ++ " (*" ++ name ++ ")("
 
 wrapped x = "_idris_get_wrapper(" ++ x ++ ")"
 
-bitOp v op ty args = v ++ "idris_b" ++ show (nativeTyWidth ty) ++ op ++ "(vm, " ++ intercalate ", " (map creg args) ++ ")"
+-- Bits8, Bits16 and Bits32 are immediates (see MKB8 in idris_rts.h), so
+-- making one doesn't allocate. Bits64 is boxed.
+mkBits :: NativeTy -> String -> String
+mkBits IT64 x = "idris_b64const(vm, " ++ x ++ ")"
+mkBits ty x = "MKB" ++ show (nativeTyWidth ty) ++ "(vm, " ++ x ++ ")"
+
+getBits :: NativeTy -> String -> String
+getBits ty x = "GETBITS" ++ show (nativeTyWidth ty) ++ "(" ++ x ++ ")"
+
+bitOp v op ty args
+    | ty /= IT64, Just f <- inlineBitOp op
+        = v ++ f ty (map (getBits ty . creg) args)
+    | otherwise
+        = v ++ "idris_b" ++ show (nativeTyWidth ty) ++ op ++ "(vm, " ++ intercalate ", " (map creg args) ++ ")"
+
+-- The cheap operations on immediate bits are done in place, rather than
+-- by a call into the RTS
+inlineBitOp :: String -> Maybe (NativeTy -> [String] -> String)
+inlineBitOp "Plus"  = arithBitOp "+"
+inlineBitOp "Minus" = arithBitOp "-"
+inlineBitOp "Times" = arithBitOp "*"
+inlineBitOp "And"   = arithBitOp "&"
+inlineBitOp "Or"    = arithBitOp "|"
+inlineBitOp "Xor"   = arithBitOp "^"
+inlineBitOp "Compl" = Just (\ty args -> mkBits ty (concatMap ("~" ++) args))
+inlineBitOp "Eq"    = cmpBitOp "=="
+inlineBitOp "Lt"    = cmpBitOp "<"
+inlineBitOp "Lte"   = cmpBitOp "<="
+inlineBitOp "Gt"    = cmpBitOp ">"
+inlineBitOp "Gte"   = cmpBitOp ">="
+inlineBitOp _       = Nothing
+
+-- In unsigned arithmetic, since a product of two Bits16 overflows an int
+arithBitOp :: String -> Maybe (NativeTy -> [String] -> String)
+arithBitOp op = Just (\ty args -> mkBits ty (intercalate (" " ++ op ++ " ") (map ("(uint32_t)" ++) args)))
+
+cmpBitOp :: String -> Maybe (NativeTy -> [String] -> String)
+cmpBitOp op = Just (\_ args -> "MKINT((i_int)(" ++ intercalate (" " ++ op ++ " ") args ++ "))")
 
 bitCoerce v op input output arg
     = v ++ "idris_b" ++ show (nativeTyWidth input) ++ op ++ show (nativeTyWidth output) ++ "(vm, " ++ creg arg ++ ")"
@@ -527,43 +666,43 @@ doOp v (LURem (ITFixed ty)) [x, y] = bitOp v "URem" ty [x, y]
 doOp v (LSRem (ATInt (ITFixed ty))) [x, y] = bitOp v "SRem" ty [x, y]
 
 doOp v (LSExt (ITFixed from) ITBig) [x]
-    = v ++ "MKBIGSI(vm, (" ++ signedTy from ++ ")" ++ creg x ++ "->info.bits" ++ show (nativeTyWidth from) ++ ")"
+    = v ++ "MKBIGSI(vm, (" ++ signedTy from ++ ")" ++ getBits from (creg x) ++ ")"
 doOp v (LSExt ITNative (ITFixed to)) [x]
-    = v ++ "idris_b" ++ show (nativeTyWidth to) ++ "const(vm, GETINT(" ++ creg x ++ "))"
+    = v ++ mkBits to ("GETINT(" ++ creg x ++ ")")
 doOp v (LSExt ITChar (ITFixed to)) [x]
     = doOp v (LSExt ITNative (ITFixed to)) [x]
 doOp v (LSExt (ITFixed from) ITNative) [x]
-    = v ++ "MKINT((i_int)((" ++ signedTy from ++ ")" ++ creg x ++ "->info.bits" ++ show (nativeTyWidth from) ++ "))"
+    = v ++ "MKINT((i_int)((" ++ signedTy from ++ ")" ++ getBits from (creg x) ++ "))"
 doOp v (LSExt (ITFixed from) ITChar) [x]
     = doOp v (LSExt (ITFixed from) ITNative) [x]
 doOp v (LSExt (ITFixed from) (ITFixed to)) [x]
     | nativeTyWidth from < nativeTyWidth to = bitCoerce v "S" from to x
 doOp v (LZExt ITNative (ITFixed to)) [x]
-    = v ++ "idris_b" ++ show (nativeTyWidth to) ++ "const(vm, (uintptr_t)GETINT(" ++ creg x ++ "))"
+    = v ++ mkBits to ("(uintptr_t)GETINT(" ++ creg x ++ ")")
 doOp v (LZExt ITChar (ITFixed to)) [x]
     = doOp v (LZExt ITNative (ITFixed to)) [x]
 doOp v (LZExt (ITFixed from) ITNative) [x]
-    = v ++ "MKINT((i_int)" ++ creg x ++ "->info.bits" ++ show (nativeTyWidth from) ++ ")"
+    = v ++ "MKINT((i_int)" ++ getBits from (creg x) ++ ")"
 doOp v (LZExt (ITFixed from) ITChar) [x]
     = doOp v (LZExt (ITFixed from) ITNative) [x]
 doOp v (LZExt (ITFixed from) ITBig) [x]
-    = v ++ "MKBIGUI(vm, " ++ creg x ++ "->info.bits" ++ show (nativeTyWidth from) ++ ")"
+    = v ++ "MKBIGUI(vm, " ++ getBits from (creg x) ++ ")"
 doOp v (LZExt ITNative ITBig) [x]
     = v ++ "MKBIGUI(vm, (uintptr_t)GETINT(" ++ creg x ++ "))"
 doOp v (LZExt (ITFixed from) (ITFixed to)) [x]
     | nativeTyWidth from < nativeTyWidth to = bitCoerce v "Z" from to x
 doOp v (LTrunc ITNative (ITFixed to)) [x]
-    = v ++ "idris_b" ++ show (nativeTyWidth to) ++ "const(vm, GETINT(" ++ creg x ++ "))"
+    = v ++ mkBits to ("GETINT(" ++ creg x ++ ")")
 doOp v (LTrunc ITChar (ITFixed to)) [x]
     = doOp v (LTrunc ITNative (ITFixed to)) [x]
 doOp v (LTrunc (ITFixed from) ITNative) [x]
-    = v ++ "MKINT((i_int)" ++ creg x ++ "->info.bits" ++ show (nativeTyWidth from) ++ ")"
+    = v ++ "MKINT((i_int)" ++ getBits from (creg x) ++ ")"
 doOp v (LTrunc (ITFixed from) ITChar) [x]
     = doOp v (LTrunc (ITFixed from) ITNative) [x]
 doOp v (LTrunc ITBig (ITFixed IT64)) [x]
     = v ++ "idris_b64const(vm, ISINT(" ++ creg x ++ ") ? GETINT(" ++ creg x ++ ") : idris_truncBigB64(GETMPZ(" ++ creg x ++ ")))"
 doOp v (LTrunc ITBig (ITFixed to)) [x]
-    = v ++ "idris_b" ++ show (nativeTyWidth to) ++ "const(vm, ISINT(" ++ creg x ++ ") ? GETINT(" ++ creg x ++ ") : mpz_get_ui(GETMPZ(" ++ creg x ++ ")))"
+    = v ++ mkBits to ("ISINT(" ++ creg x ++ ") ? GETINT(" ++ creg x ++ ") : mpz_get_ui(GETMPZ(" ++ creg x ++ "))")
 doOp v (LTrunc (ITFixed from) (ITFixed to)) [x]
     | nativeTyWidth from > nativeTyWidth to = bitCoerce v "T" from to x
 
@@ -587,9 +726,8 @@ doOp v LStrEq [l,r] = v ++ "idris_streq(vm, " ++ creg l ++ ", " ++ creg r ++ ")"
 
 doOp v LReadStr [_] = v ++ "idris_readStr(vm, stdin)"
 doOp v LWriteStr [_,s]
-             = v ++ "MKINT((i_int)(idris_writeStr(stdout"
-                 ++ ",GETSTR("
-                 ++ creg s ++ "))))"
+             = v ++ "MKINT((i_int)(idris_writeStrVal(stdout, "
+                 ++ creg s ++ ")))"
 
 
 -- String functions which need to know we're UTF8
@@ -617,9 +755,8 @@ doOp v (LExternal rf) [_,x]
        = v ++ "idris_readStr(vm, GETPTR(" ++ creg x ++ "))"
 doOp v (LExternal wf) [_,x,s]
    | wf == sUN "prim__writeFile"
-       = v ++ "MKINT((i_int)(idris_writeStr(GETPTR(" ++ creg x
-                              ++ "),GETSTR("
-                              ++ creg s ++ "))))"
+       = v ++ "MKINT((i_int)(idris_writeStrVal(GETPTR(" ++ creg x
+                              ++ "), " ++ creg s ++ ")))"
 doOp v (LExternal vm) [] | vm == sUN "prim__vm" = v ++ "MKPTR(vm, vm)"
 doOp v (LExternal si) [] | si == sUN "prim__stdin" = v ++ "MKPTR(vm, stdin)"
 doOp v (LExternal so) [] | so == sUN "prim__stdout" = v ++ "MKPTR(vm, stdout)"
@@ -812,7 +949,7 @@ genWrapper (desc, tag) =  ret ++ " " ++ wrapperName tag ++ "(" ++
                           indent 1 ++ "}\n" ++
                           indent 1 ++ "INITFRAME;\n" ++
                           indent 1 ++ "RESERVE(" ++ show (len + 1) ++ ");\n" ++
-                          indent 1 ++ "allocCon(REG1, vm, " ++ show tag ++ ",0 , 0);\n" ++
+                          indent 1 ++ "GEN_ALLOC_CON(REG1, vm, " ++ show tag ++ ", 0);\n" ++
                           indent 1 ++ "TOP(0) = REG1;\n" ++
                           applyArgs argList ++
                           if ret /= "void"